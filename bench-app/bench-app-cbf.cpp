@@ -0,0 +1,391 @@
+/*
+Counting Bloom Filter C++ Library (libCBF-cpp)
+
+Copyright (C) 2020 Lorenzo Pellegrini
+University of Bologna
+
+Based on Spatial Bloom Filter C++ Library (https://github.com/spatialbloomfilter/libSBF-cpp)
+Copyright (C) 2017  Luca Calderoni, Dario Maio,
+University of Bologna
+Copyright (C) 2017  Paolo Palmieri,
+Cranfield University
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cbflib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+//This simple program measures the cost of the main filter operations.
+//Usage: benchCBF [number of elements] [maximum bit mapping]
+//Each benchmark builds its own filter over the same synthetic elements and
+//reports the average time per operation.
+
+static std::vector<std::string> elements;
+static std::string salt_prefix = "CBFBenchSalt";
+
+//returns the average time, in nanoseconds, of one Insert
+static double bench_insert(int bit_mapping, int hf, int hn, const cbf::CBFConfig& config) {
+	std::string salt_path = salt_prefix + std::to_string(hf) + "-" + std::to_string(hn) + ".txt";
+	cbf::CBF filter(bit_mapping, hf, hn, 255, salt_path, config);
+
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& element : elements) {
+		filter.Insert(element.c_str(), (int)element.length(), 1);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	std::remove(salt_path.c_str());
+	return std::chrono::duration<double, std::nano>(end - start).count() / elements.size();
+}
+
+//compares the Insert cost of each hash family against MD4
+static void bench_hash_families(int bit_mapping, int hn) {
+	const int families[] = { 4, 1, 5, 6, 7, 8 };
+	const char* names[] = { "MD4", "SHA1", "MD5", "Murmur3", "xxHash64", "wyhash" };
+	cbf::CBFConfig config;
+
+	printf("Insert cost by hash family (%d hash runs):\n", hn);
+	double md4 = 0;
+	for (int i = 0; i < 6; i++) {
+		double ns = bench_insert(bit_mapping, families[i], hn, config);
+		if (families[i] == 4) md4 = ns;
+		printf("%-10s %10.1f ns/insert   %6.2fx vs MD4\n", names[i], ns, md4 / ns);
+	}
+	printf("\n");
+}
+
+//compares the Insert cost of each index derivation mode
+static void bench_index_modes(int bit_mapping, int hf, int hn) {
+	const int modes[] = { cbf::CBF::INDEX_SALTED, cbf::CBF::INDEX_DOUBLE_HASHING, cbf::CBF::INDEX_DIGEST_SLICING };
+	const char* names[] = { "salted", "double", "slicing" };
+	cbf::CBFConfig config;
+
+	printf("Insert cost by index mode (hash family %d, %d hash runs):\n", hf, hn);
+	double salted = 0;
+	for (int i = 0; i < 3; i++) {
+		config.index_mode = modes[i];
+		double ns = bench_insert(bit_mapping, hf, hn, config);
+		if (i == 0) salted = ns;
+		printf("%-10s %10.1f ns/insert   %6.2fx vs salted\n", names[i], ns, salted / ns);
+	}
+	printf("\n");
+}
+
+//returns the average time, in nanoseconds, of one Check of a mapped element.
+//If dependent is set, each Check starts only after the previous one returned,
+//which measures latency rather than throughput.
+static double bench_check(int bit_mapping, int hf, int hn, const cbf::CBFConfig& config, bool dependent) {
+	std::string salt_path = salt_prefix + std::to_string(hf) + "-" + std::to_string(hn) + ".txt";
+	cbf::CBF filter(bit_mapping, hf, hn, 255, salt_path, config);
+
+	for (const auto& element : elements) {
+		filter.Insert(element, 1);
+	}
+
+	size_t n = elements.size();
+	long found = 0;
+	size_t next = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < n; i++) {
+		int counter = filter.Check(elements[next]);
+		found += counter;
+		next = dependent ? (next + counter) % n : i + 1;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	std::remove(salt_path.c_str());
+	if (found < (long)n) printf("Unexpected false negatives\n");
+	return std::chrono::duration<double, std::nano>(end - start).count() / n;
+}
+
+//compares the Check cost of the classic and blocked layouts as the filter
+//grows past the CPU caches. A fast hash function is used, so that the cost
+//of memory accesses dominates.
+static void bench_layouts(int max_bit_mapping, int hn) {
+	cbf::CBFConfig classic, blocked;
+	classic.index_mode = blocked.index_mode = cbf::CBF::INDEX_DOUBLE_HASHING;
+	blocked.layout = cbf::CBF::LAYOUT_BLOCKED;
+
+	printf("Check cost by layout (wyhash, double hashing, %d hash runs):\n", hn);
+	printf("%-8s %14s %14s %8s %14s %14s %8s\n", "cells", "classic (tp)", "blocked (tp)", "speedup",
+		"classic (lat)", "blocked (lat)", "speedup");
+	for (int bit_mapping = 20; bit_mapping <= max_bit_mapping; bit_mapping += 2) {
+		double ct = bench_check(bit_mapping, 8, hn, classic, false);
+		double bt = bench_check(bit_mapping, 8, hn, blocked, false);
+		double cl = bench_check(bit_mapping, 8, hn, classic, true);
+		double bl = bench_check(bit_mapping, 8, hn, blocked, true);
+		printf("2^%-6d %11.1f ns %11.1f ns %7.2fx %11.1f ns %11.1f ns %7.2fx\n", bit_mapping,
+			ct, bt, ct / bt, cl, bl, cl / bl);
+	}
+	printf("\n");
+}
+
+//returns the average time, in nanoseconds, of one Check of a mapped element
+//performed through CheckBatch
+static double bench_check_batch(int bit_mapping, int hf, int hn, const cbf::CBFConfig& config) {
+	std::string salt_path = salt_prefix + std::to_string(hf) + "-" + std::to_string(hn) + ".txt";
+	cbf::CBF filter(bit_mapping, hf, hn, 255, salt_path, config);
+	std::vector<std::string_view> views(elements.begin(), elements.end());
+	std::vector<int> multiplicities(elements.size(), 1);
+	std::vector<int> counters(elements.size());
+
+	filter.InsertBatch(views.data(), views.size(), multiplicities.data());
+
+	auto start = std::chrono::steady_clock::now();
+	filter.CheckBatch(views.data(), views.size(), counters.data());
+	auto end = std::chrono::steady_clock::now();
+
+	std::remove(salt_path.c_str());
+	for (int counter : counters) {
+		if (counter == 0) {
+			printf("Unexpected false negatives\n");
+			break;
+		}
+	}
+	return std::chrono::duration<double, std::nano>(end - start).count() / elements.size();
+}
+
+//compares the cost of single and batched Checks as the filter grows past
+//the CPU caches
+static void bench_batch(int max_bit_mapping, int hn) {
+	cbf::CBFConfig config;
+	config.index_mode = cbf::CBF::INDEX_DOUBLE_HASHING;
+
+	printf("Check cost, single vs batched (wyhash, double hashing, %d hash runs):\n", hn);
+	printf("%-8s %14s %14s %8s\n", "cells", "Check", "CheckBatch", "speedup");
+	for (int bit_mapping = 20; bit_mapping <= max_bit_mapping; bit_mapping += 2) {
+		double single = bench_check(bit_mapping, 8, hn, config, false);
+		double batch = bench_check_batch(bit_mapping, 8, hn, config);
+		printf("2^%-6d %11.1f ns %11.1f ns %7.2fx\n", bit_mapping, single, batch, single / batch);
+	}
+	printf("\n");
+}
+
+//measures the Insert throughput of a concurrent filter as threads are added.
+//Each thread inserts its share of the elements.
+static void bench_concurrent(int bit_mapping, int hn) {
+	cbf::CBFConfig config;
+	config.index_mode = cbf::CBF::INDEX_DOUBLE_HASHING;
+	config.concurrent = true;
+	std::string salt_path = salt_prefix + "8-" + std::to_string(hn) + ".txt";
+	int max_threads = (int)std::thread::hardware_concurrency();
+
+	printf("Concurrent Insert throughput (wyhash, double hashing, %d hash runs):\n", hn);
+	printf("%-8s %16s %8s\n", "threads", "inserts/s", "scaling");
+	double single = 0;
+	for (int threads = 1; threads <= std::max(max_threads, 1); threads *= 2) {
+		cbf::CBF filter(bit_mapping, 8, hn, 255, salt_path, config);
+		std::vector<std::thread> workers;
+
+		auto start = std::chrono::steady_clock::now();
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([&filter, t, threads]() {
+				for (size_t i = t; i < elements.size(); i += threads) {
+					filter.Insert(elements[i], 1);
+				}
+			});
+		}
+		for (auto& worker : workers) worker.join();
+		auto end = std::chrono::steady_clock::now();
+
+		double rate = elements.size() / std::chrono::duration<double>(end - start).count();
+		if (threads == 1) single = rate;
+		printf("%-8d %16.0f %7.2fx\n", threads, rate, rate / single);
+	}
+	std::remove(salt_path.c_str());
+	printf("\n");
+}
+
+//compares the throughput of Insert and of BulkInsert as threads are added
+static void bench_bulk(int bit_mapping, int hn) {
+	cbf::CBFConfig config;
+	config.index_mode = cbf::CBF::INDEX_DOUBLE_HASHING;
+	std::string salt_path = salt_prefix + "8-" + std::to_string(hn) + ".txt";
+	std::vector<std::string_view> views(elements.begin(), elements.end());
+	std::vector<int> multiplicities(elements.size(), 1);
+	int max_threads = (int)std::thread::hardware_concurrency();
+
+	printf("Bulk Insert throughput (wyhash, double hashing, %d hash runs):\n", hn);
+	double single = 1e9 / bench_insert(bit_mapping, 8, hn, config);
+	printf("%-8s %16.0f\n", "Insert", single);
+	for (int threads = 1; threads <= std::max(max_threads, 1); threads *= 2) {
+		cbf::CBF filter(bit_mapping, 8, hn, 255, salt_path, config);
+		cbf::BulkStats stats = filter.BulkInsert(views.data(), multiplicities.data(), views.size(), threads);
+		printf("%-8d %16.0f %7.2fx\n", threads, stats.throughput, stats.throughput / single);
+	}
+	std::remove(salt_path.c_str());
+	printf("\n");
+}
+
+//measures the bandwidth of Merge and Intersect over the largest filter, in
+//bytes of filter per second
+static void bench_merge(int bit_mapping, int hn) {
+	cbf::CBFConfig config;
+	config.index_mode = cbf::CBF::INDEX_DOUBLE_HASHING;
+	config.forced_cell_size = 1;
+	std::string salt_path = salt_prefix + "8-" + std::to_string(hn) + ".txt";
+	cbf::CBF a(bit_mapping, 8, hn, 255, salt_path, config);
+	cbf::CBF b(bit_mapping, 8, hn, 255, salt_path, config);
+
+	for (size_t i = 0; i < elements.size(); i++) {
+		(i % 2 ? a : b).Insert(elements[i], 1);
+	}
+
+	printf("Merge and Intersect bandwidth (2^%d 1 byte cells):\n", bit_mapping);
+	auto start = std::chrono::steady_clock::now();
+	a.Merge(b);
+	auto end = std::chrono::steady_clock::now();
+	printf("%-10s %10.2f GB/s\n", "Merge", pow(2, bit_mapping) / std::chrono::duration<double, std::nano>(end - start).count());
+
+	start = std::chrono::steady_clock::now();
+	a.Intersect(b);
+	end = std::chrono::steady_clock::now();
+	printf("%-10s %10.2f GB/s\n", "Intersect", pow(2, bit_mapping) / std::chrono::duration<double, std::nano>(end - start).count());
+
+	std::remove(salt_path.c_str());
+	printf("\n");
+}
+
+//compares the allocation policies over the largest filter: the time to
+//construct the filter and insert its first element, and the latency of
+//dependent Checks once the filter is populated
+static void bench_allocation(int bit_mapping, int hn) {
+	cbf::CBFConfig configs[5];
+	const char* names[] = { "eager", "lazy", "lazy+THP", "lazy+2MiB", "interleave" };
+	for (auto& config : configs) {
+		config.index_mode = cbf::CBF::INDEX_DOUBLE_HASHING;
+		config.forced_cell_size = 2;
+		config.allocation = cbf::CBF::ALLOC_LAZY;
+	}
+	configs[0].allocation = cbf::CBF::ALLOC_EAGER;
+	configs[2].huge_pages = cbf::CBF::HUGE_PAGES_TRANSPARENT;
+	configs[3].huge_pages = cbf::CBF::HUGE_PAGES_EXPLICIT;
+	configs[4].numa = cbf::CBF::NUMA_INTERLEAVE;
+	std::string salt_path = salt_prefix + "8-" + std::to_string(hn) + ".txt";
+
+	printf("Allocation policies (2^%d 2 byte cells):\n", bit_mapping);
+	printf("%-12s %14s %14s\n", "policy", "startup", "check (lat)");
+	for (int i = 0; i < 5; i++) {
+		double startup, latency;
+		try {
+			auto start = std::chrono::steady_clock::now();
+			{
+				cbf::CBF filter(bit_mapping, 8, hn, 65535, salt_path, configs[i]);
+				filter.Insert(elements[0], 1);
+				auto end = std::chrono::steady_clock::now();
+				startup = std::chrono::duration<double, std::milli>(end - start).count();
+			}
+			latency = bench_check(bit_mapping, 8, hn, configs[i], true);
+		} catch (const std::exception& e) {
+			printf("%-12s %s\n", names[i], e.what());
+			continue;
+		}
+		printf("%-12s %11.2f ms %11.1f ns\n", names[i], startup, latency);
+	}
+
+	std::remove(salt_path.c_str());
+	printf("\n");
+}
+
+//returns the average times, in nanoseconds, of one Insert and of one Check of
+//a mapped element on the filter
+template<typename Filter>
+static void time_filter(Filter& filter, double& insert, double& check) {
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& element : elements) {
+		filter.Insert(element, 1);
+	}
+	auto middle = std::chrono::steady_clock::now();
+	long found = 0;
+	for (const auto& element : elements) {
+		found += filter.Check(element);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	if (found < (long)elements.size()) printf("Unexpected false negatives\n");
+	insert = std::chrono::duration<double, std::nano>(middle - start).count() / elements.size();
+	check = std::chrono::duration<double, std::nano>(end - middle).count() / elements.size();
+}
+
+//compares the Insert and Check costs of the CBF against a StaticCBF with the
+//same counters, hash function and hash number (wyhash, 1 byte cells, 10
+//hash runs, as sized for a 0.001 fpp)
+static void bench_static(int bit_mapping) {
+	const int hn = 10;
+	std::string salt_path = salt_prefix + "8-" + std::to_string(hn) + ".txt";
+	double insert, check, static_insert, static_check;
+	{
+		cbf::CBF filter(bit_mapping, 8, hn, 255, salt_path, 1);
+		time_filter(filter, insert, check);
+	}
+	{
+		cbf::StaticCBF<uint8_t, cbf::WyHasher, hn> filter(bit_mapping, salt_path);
+		time_filter(filter, static_insert, static_check);
+	}
+	std::remove(salt_path.c_str());
+
+	printf("Static CBF (wyhash, %d hash runs):\n", hn);
+	printf("%-10s %10s %10s\n", "", "insert", "check");
+	printf("%-10s %7.1f ns %7.1f ns\n", "CBF", insert, check);
+	printf("%-10s %7.1f ns %7.1f ns\n", "StaticCBF", static_insert, static_check);
+	printf("\n");
+}
+
+int main(int argc, char** argv) {
+	int n = 1000000;
+	int max_bit_mapping = 26;
+	if (argc > 1) n = atoi(argv[1]);
+	if (argc > 2) max_bit_mapping = atoi(argv[2]);
+	if (n <= 0) {
+		printf("Invalid number of elements\n");
+		return 1;
+	}
+	if (max_bit_mapping < 20 || max_bit_mapping > cbf::CBF::MAX_BIT_MAPPING) {
+		printf("Invalid maximum bit mapping\n");
+		return 1;
+	}
+
+	elements.reserve(n);
+	for (int i = 0; i < n; i++) {
+		elements.push_back("element-" + std::to_string(i * 2654435761u));
+	}
+
+	//sizes the filter for a 0.001 fpp, as the test application does
+	int cells = (int)ceil((double)-n * log(0.001) / pow(log(2), 2));
+	int bit_mapping = (int)ceil(log2(cells));
+	int hn = (int)ceil(((double)cells / n) * log(2));
+
+	bench_hash_families(bit_mapping, hn);
+	bench_index_modes(bit_mapping, 5, hn);
+	bench_layouts(max_bit_mapping, hn);
+	bench_batch(max_bit_mapping, hn);
+	bench_concurrent(bit_mapping, hn);
+	bench_bulk(bit_mapping, hn);
+	bench_merge(max_bit_mapping, hn);
+	bench_allocation(max_bit_mapping, hn);
+	bench_static(bit_mapping);
+
+	return 0;
+}
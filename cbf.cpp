@@ -27,23 +27,238 @@
 #define CBF_DLL
 
 #include "cbf.h"
+#include "cells.h"
+#include "fasthash.h"
 
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <type_traits>
+
+// Memory mapped filters (see CBF::MapFromDisk)
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CBF_MMAP
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 
 #include <openssl/md4.h>
 #include <openssl/md5.h>
 #include <openssl/rand.h>
 #include <openssl/sha.h>
 
+// AVX2 is used by the batched Check and by Merge and Intersect when the CPU
+// supports it. The AVX2 functions are compiled for the AVX2 target only, so
+// that the library still runs on any x86-64 CPU.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CBF_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 
 namespace cbf {
 
 /* **************************** PRIVATE METHODS **************************** */
 
 
-    // Sets the hash digest length depending on the selected hash function
+#ifdef CBF_AVX2
+    // Returns whether the CPU supports AVX2
+    static bool CpuHasAvx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+
+    // Returns the minimum counter of the native T cells at the 'count' indices
+    // in input, gathering 8 counters at a time (with two gathers of 4 64-bit
+    // indices). Counters narrower than 4 bytes are gathered as 4 bytes words
+    // and masked, so up to 3 bytes past the last cell are read (see
+    // FILTER_PADDING).
+    template<typename T>
+    __attribute__((target("avx2")))
+    static long long GatherMin(const unsigned char *filter, const uint64_t *indices, int count) {
+        const int *base = reinterpret_cast<const int *>(filter);
+        const __m128i mask = _mm_set1_epi32(sizeof(T) < 4 ? (int) ((1u << (8 * sizeof(T))) - 1) : -1);
+        __m128i half = _mm_set1_epi32(-1);
+        int k = 0;
+
+        for (; k + 8 <= count; k += 8) {
+            __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + k));
+            __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(indices + k + 4));
+            __m128i counters = _mm_min_epu32(_mm_and_si128(_mm256_i64gather_epi32(base, low, sizeof(T)), mask),
+                                             _mm_and_si128(_mm256_i64gather_epi32(base, high, sizeof(T)), mask));
+            half = _mm_min_epu32(half, counters);
+        }
+
+        half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0x4E));
+        half = _mm_min_epu32(half, _mm_shuffle_epi32(half, 0xB1));
+        long long counter = (unsigned int) _mm_cvtsi128_si32(half);
+
+        for (; k < count; k++) {
+            counter = std::min(counter, (long long) reinterpret_cast<const T *>(filter)[indices[k]]);
+        }
+
+        return counter;
+    }
+
+    // Returns a vector of native T counters set to the maximum value of the
+    // counters (INT_MAX for 4 bytes counters, see NativeCells)
+    template<typename T>
+    __attribute__((target("avx2")))
+    static inline __m256i MaxCounters() {
+        if constexpr (sizeof(T) == 1) return _mm256_set1_epi8(-1);
+        else if constexpr (sizeof(T) == 2) return _mm256_set1_epi16(-1);
+        else return _mm256_set1_epi32(INT_MAX);
+    }
+
+    // Returns a vector with all the bits of the T counters of x equal to those
+    // of y set
+    template<typename T>
+    __attribute__((target("avx2")))
+    static inline __m256i EqualCounters(__m256i x, __m256i y) {
+        if constexpr (sizeof(T) == 1) return _mm256_cmpeq_epi8(x, y);
+        else if constexpr (sizeof(T) == 2) return _mm256_cmpeq_epi16(x, y);
+        else return _mm256_cmpeq_epi32(x, y);
+    }
+
+    // Adds the 'count' native T counters of b to those of a, 32 bytes at a
+    // time, with saturating additions. AVX2 has no saturating addition of
+    // 4 bytes counters, which are added and clamped to INT_MAX (the counters
+    // are at most INT_MAX, so the sum does not wrap). Vectors where any
+    // counter saturates are left to lane(i), which adds the counters of cell
+    // i and records the exceeding amount. Returns the number of counters
+    // processed.
+    template<typename T, typename Lane>
+    __attribute__((target("avx2")))
+    static uint64_t AddCountersAvx2(unsigned char *a, const unsigned char *b, uint64_t count, Lane lane) {
+        const uint64_t lanes = 32 / sizeof(T);
+        const __m256i max = MaxCounters<T>();
+        uint64_t i = 0;
+
+        for (; i + lanes <= count; i += lanes) {
+            __m256i *va = reinterpret_cast<__m256i *>(a + i * sizeof(T));
+            __m256i x = _mm256_loadu_si256(va);
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i * sizeof(T)));
+            __m256i sum;
+            if constexpr (sizeof(T) == 1) sum = _mm256_adds_epu8(x, y);
+            else if constexpr (sizeof(T) == 2) sum = _mm256_adds_epu16(x, y);
+            else sum = _mm256_min_epu32(_mm256_add_epi32(x, y), max);
+
+            __m256i saturated = EqualCounters<T>(sum, max);
+            if (!_mm256_testz_si256(saturated, saturated)) {
+                for (uint64_t l = 0; l < lanes; l++) lane(i + l);
+                continue;
+            }
+            _mm256_storeu_si256(va, sum);
+        }
+
+        return i;
+    }
+
+    // Sets the 'count' native T counters of a to the minimum of those of a and
+    // b, 32 bytes at a time. Vectors where any counter of a is saturated (and
+    // may have overflows) are left to lane(i). Returns the number of counters
+    // processed.
+    template<typename T, typename Lane>
+    __attribute__((target("avx2")))
+    static uint64_t MinCountersAvx2(unsigned char *a, const unsigned char *b, uint64_t count, Lane lane) {
+        const uint64_t lanes = 32 / sizeof(T);
+        const __m256i max = MaxCounters<T>();
+        uint64_t i = 0;
+
+        for (; i + lanes <= count; i += lanes) {
+            __m256i *va = reinterpret_cast<__m256i *>(a + i * sizeof(T));
+            __m256i x = _mm256_loadu_si256(va);
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i * sizeof(T)));
+
+            __m256i saturated = EqualCounters<T>(x, max);
+            if (!_mm256_testz_si256(saturated, saturated)) {
+                for (uint64_t l = 0; l < lanes; l++) lane(i + l);
+                continue;
+            }
+            if constexpr (sizeof(T) == 1) _mm256_storeu_si256(va, _mm256_min_epu8(x, y));
+            else if constexpr (sizeof(T) == 2) _mm256_storeu_si256(va, _mm256_min_epu16(x, y));
+            else _mm256_storeu_si256(va, _mm256_min_epu32(x, y));
+        }
+
+        return i;
+    }
+
+    // Widens the 'count' native S counters of src to native D counters in
+    // dst, 32 bytes of dst at a time, zero-extending 16 (or 8, from 1 to 4
+    // bytes counters) source counters per vector. Returns the number of
+    // counters processed.
+    template<typename S, typename D>
+    __attribute__((target("avx2")))
+    static uint64_t WidenCountersAvx2(unsigned char *dst, const unsigned char *src, uint64_t count) {
+        const uint64_t lanes = 32 / sizeof(D);
+        uint64_t i = 0;
+
+        for (; i + lanes <= count; i += lanes) {
+            const __m128i *vs = reinterpret_cast<const __m128i *>(src + i * sizeof(S));
+            __m256i wide;
+            if constexpr (sizeof(S) == 1 && sizeof(D) == 2) wide = _mm256_cvtepu8_epi16(_mm_loadu_si128(vs));
+            else if constexpr (sizeof(S) == 1) wide = _mm256_cvtepu8_epi32(_mm_loadl_epi64(vs));
+            else wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(vs));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * sizeof(D)), wide);
+        }
+
+        return i;
+    }
+#endif
+
+    // Widens the 'count' native S counters of src to native D counters in
+    // dst, with SIMD instructions where available
+    template<typename S, typename D>
+    static void WidenCounters(unsigned char *dst, const unsigned char *src, uint64_t count) {
+        uint64_t i = 0;
+
+#ifdef CBF_AVX2
+        if (CpuHasAvx2()) i = WidenCountersAvx2<S, D>(dst, src, count);
+#endif
+        for (; i < count; i++) {
+            reinterpret_cast<D *>(dst)[i] = reinterpret_cast<const S *>(src)[i];
+        }
+    }
+
+
+    // Computes the digest of the input XORed with a hash salt, using the given
+    // OpenSSL hash context functions. The input is fed to the hash context in
+    // chunks of MAX_INPUT_SIZE bytes and the salt is repeated over longer
+    // inputs, so that elements of any length can be hashed without heap
+    // allocations. For inputs up to MAX_INPUT_SIZE bytes the digest is the
+    // same as the one of the salted input hashed at once.
+    template<typename Context>
+    static void SaltedDigest(const char *d, size_t n, const BYTE *salt, unsigned char *md,
+                             int (*init)(Context *), int (*update)(Context *, const void *, size_t),
+                             int (*final)(unsigned char *, Context *)) {
+        unsigned char buffer[CBF::MAX_INPUT_SIZE];
+        Context context;
+
+        init(&context);
+        for (size_t offset = 0; offset < n; offset += CBF::MAX_INPUT_SIZE) {
+            size_t chunk = std::min(n - offset, (size_t) CBF::MAX_INPUT_SIZE);
+            for (size_t j = 0; j < chunk; j++) {
+                buffer[j] = (unsigned char) (d[offset + j] ^ salt[j]);
+            }
+            update(&context, buffer, chunk);
+        }
+        final(md, &context);
+    }
+
+
+    // Sets the hash digest length depending on the selected hash function.
+    // Unknown hash families are rejected.
     void CBF::SetHashDigestLength() {
         switch (this->HASH_family) {
             case 1:
@@ -55,30 +270,52 @@ namespace cbf {
             case 5:
                 this->HASH_digest_length = MD5_DIGEST_LENGTH;
                 break;
-            default:
-                this->HASH_digest_length = MD4_DIGEST_LENGTH;
+            case 6:
+                this->HASH_digest_length = 16;
+                break;
+            case 7:
+            case 8:
+                this->HASH_digest_length = 8;
                 break;
+            default:
+                throw std::invalid_argument("Invalid hash family.");
         }
     }
 
 
-    // Computes the hash digest, calling the selected hash function
+    // Computes the hash digest of the input combined with the k-th hash salt,
+    // calling the selected hash function. Cryptographic hash functions are
+    // given the input XORed with the salt, while non-cryptographic ones
+    // use the first 8 bytes of the salt as their seed. Seeds and digests are
+    // little endian, so that digests do not depend on the byte order of the
+    // machine.
     // char *d            is the input of the hash value
     // size_t n           is the input length
+    // int k              is the number of the salt to be used
     // unsigned char *md  is where the output should be written
-    void CBF::Hash(char *d, size_t n, unsigned char *md) const {
+    void CBF::Hash(const char *d, size_t n, int k, unsigned char *md) const {
+        const uint64_t seed = load_le64(this->HASH_salt[k]);
+
         switch (this->HASH_family) {
             case 1:
-                SHA1((unsigned char *) d, n, (unsigned char *) md);
+                SaltedDigest(d, n, this->HASH_salt[k], md, SHA1_Init, SHA1_Update, SHA1_Final);
                 break;
             case 4:
-                MD4((unsigned char *) d, n, (unsigned char *) md);
+                SaltedDigest(d, n, this->HASH_salt[k], md, MD4_Init, MD4_Update, MD4_Final);
                 break;
             case 5:
-                MD5((unsigned char *) d, n, (unsigned char *) md);
+                SaltedDigest(d, n, this->HASH_salt[k], md, MD5_Init, MD5_Update, MD5_Final);
+                break;
+            case 6:
+                murmur3_128(d, n, seed, md);
+                break;
+            case 7:
+                store_le64(md, xxh64(d, n, seed));
+                break;
+            case 8:
+                store_le64(md, wyhash(d, n, seed));
                 break;
             default:
-                MD4((unsigned char *) d, n, (unsigned char *) md);
                 break;
         }
     }
@@ -115,6 +352,8 @@ namespace cbf {
 
     // Loads from the path in input a hash salt byte array, one line per hash.
     // Hashes are stored encoded in base64, and need to be decoded.
+    // Throws std::runtime_error if the file holds fewer than HASH_number
+    // salts (it was created for fewer hash runs), or shorter ones.
     void CBF::LoadHashSalt(const std::string &path) {
         std::ifstream myfile;
         std::string line;
@@ -123,80 +362,719 @@ namespace cbf {
 
         for (int i = 0; i < this->HASH_number; i++) {
             // Reads one base64 hash salt from file (one per line)
-            getline(myfile, line);
+            if (!getline(myfile, line)) {
+                throw std::runtime_error("The hash salt file " + path + " holds fewer than "
+                                         + std::to_string(this->HASH_number) + " salts.");
+            }
 
             //decode and fill hash salt matrix
-            memcpy(this->HASH_salt[i], cbf::base64_decode(line).c_str(), CBF::MAX_INPUT_SIZE);
+            std::string salt = cbf::base64_decode(line);
+            if (salt.size() < (size_t) CBF::MAX_INPUT_SIZE) {
+                throw std::runtime_error("Invalid hash salt in the file " + path);
+            }
+            memcpy(this->HASH_salt[i], salt.data(), CBF::MAX_INPUT_SIZE);
         }
 
         myfile.close();
     }
 
 
-    // Sets the cell by incrementing the cell counter. This method is called
-    // by Insert with the cell index and the multiplicity. It manages the two
-    // different possible cell sizes (one or two bytes) automatically set during
-    // filter construction.
-    void CBF::SetCell(unsigned int index, int multiplicity) {
-        int max_multiplicity = this->cell_size == 1 ? 255 : 65535;
-        int cell_value = this->GetCell(index);
-        int new_cell_value = cell_value + multiplicity;
-        int n_overflows = new_cell_value - max_multiplicity;
+    // Reads 4 bytes of a digest as a 32-bit word, in little endian order
+    // whatever the byte order of the machine, so that filters map elements
+    // to the same cells on every machine (see SaveToDisk)
+    static inline unsigned int DigestWord(const unsigned char *p) {
+        return ((unsigned int) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+    }
+
+
+    // Computes the cell indices of the element in input, starting from the
+    // index number 'first', and writes them to indices[first], indices[first+1]...
+    // Returns the number of indices computed, which depends on the index mode:
+    // in INDEX_SALTED mode one salted digest is computed and a single index is
+    // returned, in INDEX_DIGEST_SLICING mode one salted digest is computed and
+    // cut into as many 'bit_mapping' wide indices as it holds, while in
+    // INDEX_DOUBLE_HASHING mode all the HASH_number indices are derived from
+    // one digest, so the whole array is filled at once.
+    // Callers can thus compute the indices lazily (see Check).
+    // Filters whose number of cells is not a power of 2 map the digests to the
+    // cells with FastRange (see above).
+    // std::string_view element the element to be mapped
+    // uint64_t *indices        where the indices are written (HASH_number entries)
+    // int first                number of the first index to be computed
+    int CBF::ComputeIndices(std::string_view element, uint64_t *indices, const int first) const {
+        unsigned char digest[SHA_DIGEST_LENGTH];
+        int k = 0;
+
+        if (this->INDEX_mode == CBF::INDEX_SALTED) k = first;
+        else if (this->INDEX_mode == CBF::INDEX_DIGEST_SLICING) k = first / this->digest_indices;
+
+        // Combines the input char array with the hash salt of the k-th digest
+        this->Hash(element.data(), element.size(), k, digest);
+
+        if (this->INDEX_mode == CBF::INDEX_DIGEST_SLICING) {
+            // Reads the digest as a big endian bit string and cuts it in
+            // consecutive 'slice_bits' wide slices (bit_mapping wide, unless
+            // the number of cells is not a power of 2). The accumulator never
+            // holds more than slice_bits + 7 bits. Slices are mapped to the
+            // cells as the most significant bits of a 64-bit word, which
+            // leaves them unchanged in filters of 2^bit_mapping cells.
+            int count = std::min(this->digest_indices, this->HASH_number - first);
+            uint64_t accumulator = 0;
+            int accumulator_bits = 0;
+            int position = 0;
+            for (int i = 0; i < count; i++) {
+                while (accumulator_bits < this->slice_bits) {
+                    accumulator = (accumulator << 8) | digest[position++];
+                    accumulator_bits += 8;
+                }
+                accumulator_bits -= this->slice_bits;
+                uint64_t slice = (accumulator >> accumulator_bits) & ((1ULL << this->slice_bits) - 1);
+                indices[first + i] = CBF::FastRange(slice << (64 - this->slice_bits), this->cells);
+            }
+            this->MapToBlock(indices, first, count);
+            return count;
+        }
+
+        // Copies the first two 32-bit words of the digest (one byte at a time)
+        // in two integer variables (endian independent), which make the
+        // 64-bit word w1
+        unsigned int h1 = DigestWord(digest);
+        unsigned int h2 = DigestWord(digest + 4);
+        uint64_t w1 = ((uint64_t) h1 << 32) | h2;
+
+        // The index is given by the most significant bits of w1, which are
+        // the first 'bit_mapping' most significant bits of h1 in filters of
+        // up to 2^32 cells
+        if (this->INDEX_mode == CBF::INDEX_SALTED) {
+            indices[first] = CBF::FastRange(w1, this->cells);
+            this->MapToBlock(indices, first, 1);
+            return 1;
+        }
+
+        // Enhanced double hashing (Dillinger and Manolios): the i-th index is
+        // h1 + i*h2 + (i^3 - i)/6 modulo 2^bit_mapping, computed incrementally.
+        // The step h2 is made odd, so that it is coprime with the filter size,
+        // and the cubic term further avoids degenerate sequences. This matters
+        // most in LAYOUT_BLOCKED layout, where only the least significant
+        // bits of each index are used.
+        if (this->is_power_of_2 && this->bit_mapping <= 32) {
+            const int shift = 32 - this->bit_mapping;
+            const unsigned int mask = (unsigned int) ((1ULL << this->bit_mapping) - 1);
+            h1 >>= shift;
+            h2 = (h2 >> shift) | 1;
+            for (int i = 0; i < this->HASH_number; i++) {
+                indices[i] = h1 & mask;
+                h1 += h2;
+                h2 += i + 1;
+            }
+            this->MapToBlock(indices, 0, this->HASH_number);
+            return this->HASH_number;
+        }
+
+        // Any other number of cells m: the same progression modulo m, with
+        // its start and its step taken from two 64-bit words. The step is
+        // kept in [1, m - 1], as a step of 0 would repeat the same index.
+        // Digests of 8 bytes have a single word, and the second one is
+        // derived from it (with the SplitMix64 finalizer).
+        uint64_t w2;
+        if (this->HASH_digest_length >= 16) {
+            w2 = ((uint64_t) DigestWord(digest + 8) << 32) | DigestWord(digest + 12);
+        } else {
+            w2 = (w1 ^ (w1 >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            w2 = (w2 ^ (w2 >> 27)) * 0x94D049BB133111EBULL;
+            w2 ^= w2 >> 31;
+        }
+        const uint64_t m = this->cells;
+        uint64_t a = CBF::FastRange(w1, m);
+        uint64_t b = 1 + CBF::FastRange(w2, m - 1);
+        for (int i = 0; i < this->HASH_number; i++) {
+            indices[i] = a;
+            a += b;
+            if (a >= m) a -= m;
+            b += i + 1;
+            if (b >= m) b = 1 + (b - 1) % (m - 1);
+        }
+        this->MapToBlock(indices, 0, this->HASH_number);
+        return this->HASH_number;
+    }
+
+
+    // In LAYOUT_BLOCKED layout, moves the indices[first]...indices[first+count-1]
+    // inside the block selected by indices[0]. The block is given by the most
+    // significant bits of indices[0], while the position of each cell inside
+    // the block is taken from the most significant bits of its own index
+    // multiplied by an odd constant (Fibonacci hashing), so that it depends
+    // on all the bits of the index. Otherwise, the few least significant bits
+    // of the arithmetic progressions of INDEX_DOUBLE_HASHING would allow only
+    // block_cells^2 different sets of cells in each block.
+    // In LAYOUT_CLASSIC layout, does nothing.
+    void CBF::MapToBlock(uint64_t *indices, const int first, const int count) const {
+        if (this->LAYOUT_mode != CBF::LAYOUT_BLOCKED) return;
+
+        const uint64_t offset_mask = (uint64_t) this->block_cells - 1;
+        const uint64_t block = indices[0] & ~offset_mask;
+        for (int i = first; i < first + count; i++) {
+            indices[i] = block | (((unsigned int) indices[i] * 0x9E3779B1u) >> this->block_shift);
+        }
+    }
 
-        if ((multiplicity > max_multiplicity) || (multiplicity < 0)) {
-            std::string error_message = "Multiplicity must be in [1, ";
-            error_message += std::to_string(max_multiplicity);
+
+    // Increments the counter of the cell at the specified index by the
+    // multiplicity in input. Counters saturate at the maximum value allowed by
+    // the cell size, and the exceeding amount is recorded as overflows (or
+    // spills into the upper layers of a multilayer CBF).
+    // Cells is the counter storage policy matching the cell size (see cells.h).
+    template<typename Cells>
+    void CBF::IncrementCell(uint64_t index, int multiplicity) {
+        if (multiplicity < 0) {
+            std::string error_message = "Multiplicity must be in [0, ";
+            error_message += std::to_string(CBF::MAX_MULTIPLICITY);
             error_message += "]\n";
             throw std::invalid_argument(error_message);
         }
 
-        if (n_overflows > 0) {
-            overflows[index] += n_overflows;
+        int cell_value = Cells::AddSaturated(this->filter, index, multiplicity);
+
+        // Computed in 64 bits, as 4 bytes counters can go past INT_MAX
+        long long new_cell_value = (long long) cell_value + multiplicity;
+        if (new_cell_value > Cells::MAX) this->AddExcess(index, new_cell_value - Cells::MAX);
+
+        if (cell_value == 0 && multiplicity != 0) this->CountNonZeroCell(index, 1);
+    }
+
+
+    // Increments the counters of the 'HASH_number' cells in input.
+    // This is the Insert kernel for the counter storage policy Cells.
+    template<typename Cells>
+    void CBF::InsertKernel(const uint64_t *indices, int multiplicity) {
+        for (int k = 0; k < this->HASH_number; k++) {
+            this->IncrementCell<Cells>(indices[k], multiplicity);
         }
+    }
 
-        new_cell_value = std::min(max_multiplicity, new_cell_value);
 
-        switch (this->cell_size) {
-            // 1-byte cell size
-            case 1:
-                this->filter[index] = new_cell_value;
-                break;
-                // 2-bytes cell size. Writing values over the two bytes is managed
-                // manually, by copying byte per byte
-            case 2:
+    // Raises the counters of the 'HASH_number' cells in input only as far as
+    // the new counter of the element requires: its current counter (the
+    // minimum over the cells, their overflows included) plus the
+    // multiplicity. Indices may repeat, in which case the cell is raised
+    // once.
+    // This is the conservative update Insert kernel for the counter storage
+    // policy Cells.
+    template<typename Cells>
+    void CBF::ConservativeInsertKernel(const uint64_t *indices, int multiplicity) {
+        if (multiplicity < 0) {
+            std::string error_message = "Multiplicity must be in [0, ";
+            error_message += std::to_string(CBF::MAX_MULTIPLICITY);
+            error_message += "]\n";
+            throw std::invalid_argument(error_message);
+        }
 
-                this->filter[2 * index] = (BYTE) (new_cell_value >> 8);
-                this->filter[(2 * index) + 1] = (BYTE) new_cell_value;
-                break;
-            default:
-                break;
+        long long counter = this->CellCounter<Cells>(indices[0], true);
+        for (int k = 1; k < this->HASH_number; k++) {
+            counter = std::min(counter, this->CellCounter<Cells>(indices[k], true));
+        }
+
+        const long long target = counter + multiplicity;
+        for (int k = 0; k < this->HASH_number; k++) {
+            long long cell_counter = this->CellCounter<Cells>(indices[k], true);
+            if (cell_counter < target) this->IncrementCell<Cells>(indices[k], (int) (target - cell_counter));
         }
     }
 
 
-    // Returns the counter stored at the specified index
-    int CBF::GetCell(unsigned int index) const {
-        int counter;
+    // Decrements the counter of the cell at the specified index by the
+    // multiplicity in input, which must not exceed the actual counter (see
+    // RemoveKernel). The overflows (or upper layers) of a saturated cell are
+    // decremented first, so that the cell stays saturated while they last.
+    // Saturated cells are left unchanged if overflows are not tracked.
+    template<typename Cells>
+    void CBF::DecrementCell(uint64_t index, int multiplicity) {
+        int cell_value = Cells::Get(this->filter, index);
+        long long amount = multiplicity;
+
+        if (cell_value == Cells::MAX) {
+            if (this->multilayer) {
+                amount = this->layers.Subtract(index, amount);
+            } else if (this->track_overflows) {
+                long long overflow = std::min(amount, this->GetOverflow(index));
+                this->AddOverflow(index, -overflow);
+                amount -= overflow;
+            } else {
+                return;
+            }
+        }
+
+        if (amount == 0) return;
+
+        Cells::Set(this->filter, index, (int) (cell_value - amount));
+        if (cell_value == amount) this->CountNonZeroCell(index, -1);
+    }
+
+
+    // Decrements the counters of the 'HASH_number' cells in input.
+    // The actual counter of each cell (its overflows included) is checked
+    // first: if any would go below 0, the element was not mapped with that
+    // multiplicity and the filter is left unchanged. Indices may repeat, in
+    // which case the cell is decremented once for each of them.
+    // This is the Remove kernel for the counter storage policy Cells.
+    template<typename Cells>
+    void CBF::RemoveKernel(const uint64_t *indices, int multiplicity) {
+        uint64_t sorted[CBF::MAX_HASH_NUMBER];
+
+        std::copy(indices, indices + this->HASH_number, sorted);
+        std::sort(sorted, sorted + this->HASH_number);
+
+        for (int k = 0; k < this->HASH_number;) {
+            int repeats = 1;
+            while (k + repeats < this->HASH_number && sorted[k + repeats] == sorted[k]) repeats++;
+
+            long long counter = Cells::Get(this->filter, sorted[k]);
+            bool known = true;
+            if (counter == Cells::MAX) {
+                if (this->multilayer) counter += this->layers.Get(sorted[k]);
+                else if (this->track_overflows) counter += this->GetOverflow(sorted[k]);
+                else known = false;
+            }
+            if (known && counter < (long long) multiplicity * repeats) {
+                throw std::underflow_error("Element not in the filter with the given multiplicity.");
+            }
+
+            k += repeats;
+        }
+
+        for (int k = 0; k < this->HASH_number; k++) {
+            this->DecrementCell<Cells>(indices[k], multiplicity);
+        }
+    }
+
+
+    // Returns the counter of the cell at the specified index. If with_overflows
+    // is set, the overflows of a saturated cell are added to its counter, so
+    // that counters above the cell limit are exact. In a multilayer CBF,
+    // counters are always exact.
+    template<typename Cells>
+    long long CBF::CellCounter(uint64_t index, bool with_overflows) const {
+        long long counter = Cells::Get(this->filter, index);
+
+        if (counter == Cells::MAX) {
+            if (this->multilayer) counter += this->layers.Get(index);
+            else if (with_overflows) counter += this->GetOverflow(index);
+        }
+
+        return counter;
+    }
+
+
+    // Applies the cell increments in input, which BulkInsert collected for a
+    // shard of the filter, and appends the amounts exceeding saturated
+    // counters to excess, so that they are recorded once all shards are done.
+    // This is the bulk Insert kernel for the counter storage policy Cells.
+    template<typename Cells>
+    void CBF::BulkKernel(const std::vector<CellUpdate> &updates, std::vector<CellUpdate> &excess) {
+        for (const CellUpdate &update : updates) {
+            long long value = (long long) Cells::AddSaturated(this->filter, update.index, update.multiplicity);
+            value += update.multiplicity;
+            if (value > Cells::MAX) excess.push_back({update.index, (int) (value - Cells::MAX)});
+        }
+    }
+
+
+    // Adds the counters of the other filter, overflows included, to those of
+    // this filter (see Merge). Counters are added with SIMD instructions where
+    // available, and cell by cell where they saturate.
+    // This is the Merge kernel for the counter storage policy Cells. The
+    // counters of the other filter are read with the storage policy
+    // OtherCells, when it is narrower (see MergeNarrower).
+    template<typename Cells, typename OtherCells>
+    void CBF::MergeKernel(const CBF &other) {
+        auto lane = [this, &other](uint64_t i) {
+            long long counter = Cells::Get(this->filter, i) + other.CellCounter<OtherCells>(i, true);
+            if (counter > Cells::MAX) {
+                this->AddExcess(i, counter - Cells::MAX);
+                counter = Cells::MAX;
+            }
+            Cells::Set(this->filter, i, (int) counter);
+        };
+        uint64_t i = 0;
+
+#ifdef CBF_AVX2
+        if constexpr (Cells::NATIVE && std::is_same_v<Cells, OtherCells>) {
+            if (CpuHasAvx2()) {
+                i = AddCountersAvx2<typename Cells::Counter>(this->filter, other.filter, this->cells, lane);
+            }
+        }
+#endif
+        for (; i < this->cells; i++) lane(i);
+    }
+
+
+    // Sets the counters of this filter, overflows included, to the minimum of
+    // those of the two filters (see Intersect). Counters are compared with
+    // SIMD instructions where available, and cell by cell where the counters
+    // of this filter are saturated.
+    // This is the Intersect kernel for the counter storage policy Cells. The
+    // counters of the other filter are read with the storage policy
+    // OtherCells, when it is narrower (see IntersectNarrower).
+    template<typename Cells, typename OtherCells>
+    void CBF::IntersectKernel(const CBF &other) {
+        auto lane = [this, &other](uint64_t i) {
+            long long counter = this->CellCounter<Cells>(i, true);
+            long long minimum = std::min(counter, other.CellCounter<OtherCells>(i, true));
+            if (counter > Cells::MAX) {
+                this->RemoveExcess(i, counter - std::max(minimum, (long long) Cells::MAX));
+            }
+            Cells::Set(this->filter, i, (int) std::min(minimum, (long long) Cells::MAX));
+        };
+        uint64_t i = 0;
+
+#ifdef CBF_AVX2
+        if constexpr (Cells::NATIVE && std::is_same_v<Cells, OtherCells>) {
+            if (CpuHasAvx2()) {
+                i = MinCountersAvx2<typename Cells::Counter>(this->filter, other.filter, this->cells, lane);
+            }
+        }
+#endif
+        for (; i < this->cells; i++) lane(i);
+    }
+
+
+    // Returns the minimum counter of the cells the element is mapped to (see
+    // CellCounter for with_overflows).
+    // This is the Check kernel for the counter storage policy Cells.
+    template<typename Cells>
+    int CBF::CheckKernel(std::string_view element, bool with_overflows) const {
+        uint64_t indices[CBF::MAX_HASH_NUMBER];
+        int computed = 0;
+        long long counter = INT_MAX;
+
+        for (int k = 0; k < this->HASH_number; k++) {
+            // Indices are computed lazily, so that no digest is wasted when
+            // the check ends early
+            if (k == computed) {
+                computed += this->ComputeIndices(element, indices, k);
+            }
+
+            counter = std::min(counter, this->CellCounter<Cells>(indices[k], with_overflows));
+            // If one hash points to an empty cell, the element does not belong
+            // to any set.
+            if (counter == 0) break;
+        }
+
+        return (int) counter;
+    }
+
+
+    // Returns the minimum counter of the 'HASH_number' cells in input, whose
+    // indices were already computed (and whose cells were prefetched) by
+    // CheckBatch. If GATHER is set, the counters are gathered with AVX2 first,
+    // and the cells are only read one by one when the minimum counter is
+    // saturated, so that overflows may apply.
+    // This is the batched Check kernel for the counter storage policy Cells.
+    template<typename Cells, bool GATHER>
+    int CBF::ResolveKernel(const uint64_t *indices, bool with_overflows) const {
+        long long counter = INT_MAX;
+
+#ifdef CBF_AVX2
+        if constexpr (GATHER) {
+            counter = GatherMin<typename Cells::Counter>(this->filter, indices, this->HASH_number);
+            if (counter != Cells::MAX) return (int) counter;
+            counter = INT_MAX;
+        }
+#endif
+
+        for (int k = 0; k < this->HASH_number; k++) {
+            counter = std::min(counter, this->CellCounter<Cells>(indices[k], with_overflows));
+            if (counter == 0) break;
+        }
+
+        return (int) counter;
+    }
+
+
+    // Selects the cell accessors and the Insert and Check kernels of the
+    // counter storage policy Cells, and sets the maximum value of the counters
+    template<typename Cells>
+    void CBF::SelectCells() {
+        this->cell_max = Cells::MAX;
+        this->set_cell = &CBF::IncrementCell<Cells>;
+        this->get_cell = &Cells::Get;
+        this->insert_kernel = &CBF::InsertKernel<Cells>;
+        if (this->conservative_update) this->insert_kernel = &CBF::ConservativeInsertKernel<Cells>;
+        this->remove_kernel = &CBF::RemoveKernel<Cells>;
+        this->bulk_kernel = &CBF::BulkKernel<Cells>;
+        this->merge_kernel = &CBF::MergeKernel<Cells>;
+        this->intersect_kernel = &CBF::IntersectKernel<Cells>;
+        this->check_kernel = &CBF::CheckKernel<Cells>;
+        this->resolve_kernel = &CBF::ResolveKernel<Cells, false>;
+#ifdef CBF_AVX2
+        // Gathers are only worth it for 8 indices or more
+        if constexpr (Cells::NATIVE) {
+            if (CpuHasAvx2() && this->HASH_number >= 8) {
+                this->resolve_kernel = &CBF::ResolveKernel<Cells, true>;
+            }
+        }
+#endif
+        this->count_kernel = &Cells::CountNonZero;
+    }
+
+
+    // Selects the packed counters of cell_bits bits, trying the widths from
+    // W up to 16
+    template<int W>
+    void CBF::SelectPackedCells() {
+        if (this->cell_bits == W) this->SelectCells<PackedCells<W> >();
+        else this->SelectPackedCells<W + 1>();
+    }
+
+    template<>
+    void CBF::SelectPackedCells<17>() {
+        throw std::invalid_argument("Cell bits must be in [1, 16]");
+    }
+
+
+    // Selects the counter storage policy matching the cell size (or the
+    // counters width, when counters are packed). Concurrent CBFs use atomic
+    // counters.
+    void CBF::SelectKernels() {
         switch (this->cell_size) {
-            // 1-byte cell size
+            case 0:
+                this->SelectPackedCells<1>();
+                break;
             case 1:
-                return (int) this->filter[index];
+                if (this->concurrent) this->SelectCells<AtomicCells<uint8_t> >();
+                else this->SelectCells<Cells8>();
                 break;
-                // 2-bytes cell size:
-                // here we need to copy values byte per byte
             case 2:
-                // Copies counter (one byte at a time) in two adjacent bytes
-                counter = (int) ((this->filter[2 * index] << 8) | this->filter[(2 * index) + 1]);
-                return counter;
+                if (this->concurrent) this->SelectCells<AtomicCells<uint16_t> >();
+                else this->SelectCells<Cells16>();
                 break;
             default:
-                // This condition should never be reached
-                return -1;
+                if (this->concurrent) this->SelectCells<AtomicCells<uint32_t> >();
+                else this->SelectCells<Cells32>();
                 break;
         }
     }
 
 
+    // Sets the cell by incrementing the cell counter (see IncrementCell).
+    // Counters are stored as native integers of 1, 2 or 4 bytes, or packed,
+    // depending on the cell size automatically set during filter construction.
+    void CBF::SetCell(uint64_t index, int multiplicity) {
+        (this->*set_cell)(index, multiplicity);
+    }
+
+
+    // Returns the counter stored at the specified index
+    int CBF::GetCell(uint64_t index) const {
+        return this->get_cell(this->filter, index);
+    }
+
+
+    // Prefetches the cache line holding the cell at the specified index, for
+    // reading or for writing
+    void CBF::PrefetchCell(uint64_t index, bool write) const {
+        const BYTE *cell = this->filter + (((uint64_t) index * this->cell_bits) >> 3);
+#if defined(__GNUC__) || defined(__clang__)
+        if (write) __builtin_prefetch(cell, 1);
+        else __builtin_prefetch(cell, 0);
+#elif defined(_MSC_VER)
+        _mm_prefetch(reinterpret_cast<const char *>(cell), _MM_HINT_T0);
+#endif
+    }
+
+
+    // Updates the statistics when the cell at the specified index becomes
+    // non-zero (delta = 1) or zero (delta = -1)
+    void CBF::CountNonZeroCell(uint64_t index, int delta) {
+        if (this->concurrent) {
+            std::atomic_ref<uint64_t>(this->nonzero_cells).fetch_add(delta, std::memory_order_relaxed);
+            if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) {
+                uint16_t &block = this->block_nonzero[index / this->block_cells];
+                uint16_t previous = std::atomic_ref<uint16_t>(block).fetch_add(delta, std::memory_order_relaxed);
+                std::atomic_ref<double>(this->block_fpp_sum).fetch_add(
+                        this->block_fpp[previous + delta] - this->block_fpp[previous], std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        this->nonzero_cells += delta;
+
+        if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) {
+            uint16_t &block = this->block_nonzero[index / this->block_cells];
+            this->block_fpp_sum += this->block_fpp[block + delta] - this->block_fpp[block];
+            block += delta;
+        }
+    }
+
+
+    // Returns the number of non-zero cells (see CountNonZeroCell)
+    uint64_t CBF::NonZeroCells() const {
+        if (!this->concurrent) return this->nonzero_cells;
+        return std::atomic_ref<uint64_t>(const_cast<uint64_t &>(this->nonzero_cells)).load(std::memory_order_relaxed);
+    }
+
+
+    // Returns the sum of the fpp of the blocks (see CountNonZeroCell)
+    double CBF::BlockFppSum() const {
+        // The statistics of a mapped filter are computed at their first use
+        // (see MapFromDisk)
+        if (this->stats_deferred) {
+            std::call_once(this->stats_once, &CBF::RecountCells, const_cast<CBF *>(this));
+        }
+        if (!this->concurrent) return this->block_fpp_sum;
+        return std::atomic_ref<double>(const_cast<double &>(this->block_fpp_sum)).load(std::memory_order_relaxed);
+    }
+
+
+    // Adds amount (which may be negative) to the overflows of the cell at
+    // the specified index
+    void CBF::AddOverflow(uint64_t index, long long amount) {
+        std::unique_lock<std::shared_mutex> lock(this->overflow_mutex, std::defer_lock);
+        if (this->concurrent) lock.lock();
+
+        this->overflows.Add(index, amount);
+    }
+
+
+    // Records the amount exceeding the saturated counter of the cell at the
+    // specified index: as overflows or, in a multilayer CBF, in the upper
+    // layers. The amount is dropped if overflows are not tracked.
+    void CBF::AddExcess(uint64_t index, long long amount) {
+        if (this->multilayer) this->layers.Add(index, amount);
+        else if (this->track_overflows) this->AddOverflow(index, amount);
+    }
+
+
+    // Removes part of the amount recorded by AddExcess for the cell at the
+    // specified index
+    void CBF::RemoveExcess(uint64_t index, long long amount) {
+        if (this->multilayer) this->layers.Subtract(index, amount);
+        else if (this->track_overflows) this->AddOverflow(index, -amount);
+    }
+
+
+    // Throws std::invalid_argument if the other filter does not map elements
+    // to the same cells as this one, with counters of the same size (or of
+    // any size, if both filters are adaptive: see Merge)
+    void CBF::CheckCompatible(const CBF &other) const {
+        if (this->bit_mapping != other.bit_mapping) throw std::invalid_argument("Incompatible filters: bit mapping.");
+        if (this->cells != other.cells) throw std::invalid_argument("Incompatible filters: number of cells.");
+        if (this->HASH_family != other.HASH_family) throw std::invalid_argument("Incompatible filters: hash family.");
+        if (this->HASH_number != other.HASH_number) throw std::invalid_argument("Incompatible filters: hash number.");
+        if (this->INDEX_mode != other.INDEX_mode) throw std::invalid_argument("Incompatible filters: index mode.");
+        if (this->LAYOUT_mode != other.LAYOUT_mode) throw std::invalid_argument("Incompatible filters: layout.");
+        if (!(this->adaptive && other.adaptive) && this->cell_bits != other.cell_bits) {
+            throw std::invalid_argument("Incompatible filters: cell size.");
+        }
+        // A filter that allows Remove must not take conservative counters
+        if (this->conservative_update != other.conservative_update) throw std::invalid_argument("Incompatible filters: update mode.");
+        for (int j = 0; j < this->HASH_number; j++) {
+            if (memcmp(this->HASH_salt[j], other.HASH_salt[j], CBF::MAX_INPUT_SIZE) != 0) {
+                throw std::invalid_argument("Incompatible filters: hash salts.");
+            }
+        }
+    }
+
+
+    // Returns the overflows of the cell at the specified index
+    long long CBF::GetOverflow(uint64_t index) const {
+        std::shared_lock<std::shared_mutex> lock(this->overflow_mutex, std::defer_lock);
+        if (this->concurrent) lock.lock();
+
+        return this->overflows.Get(index);
+    }
+
+
+    // Returns the members counters of the calling thread in a concurrent CBF.
+    // Threads are assigned the counters in turn, the first time they insert.
+    static int ThreadStripe() {
+        static std::atomic<unsigned int> next_stripe(0);
+        thread_local int stripe = (int) (next_stripe++ % CBF::MEMBER_STRIPES);
+        return stripe;
+    }
+
+
+    // Adds the number of elements and their multiplicity to the members
+    // counters
+    void CBF::AddMembers(long long elements, long long multiplicity) {
+        if (this->concurrent) {
+            MemberStripe &stripe = this->member_stripes[ThreadStripe()];
+            stripe.unique_members.fetch_add(elements, std::memory_order_relaxed);
+            stripe.members.fetch_add(multiplicity, std::memory_order_relaxed);
+            return;
+        }
+
+        this->unique_members += elements;
+        this->members += multiplicity;
+    }
+
+
+    // Widens the counters of the filter to native counters of cell_size bytes
+    // (2 or 4), with a single pass over the filter array, and reselects the
+    // kernels. Saturated counters are then raised by their overflows, as far
+    // as the wider counters allow.
+    void CBF::WidenCells(int cell_size) {
+        BYTE *narrow = this->filter;
+
+        this->filter = new (std::align_val_t(CBF::BLOCK_SIZE)) BYTE[this->cells * cell_size + CBF::FILTER_PADDING];
+        memset(this->filter + this->cells * cell_size, 0, CBF::FILTER_PADDING);
+        if (this->cell_size == 1 && cell_size == 2) WidenCounters<uint8_t, uint16_t>(this->filter, narrow, this->cells);
+        else if (this->cell_size == 1) WidenCounters<uint8_t, uint32_t>(this->filter, narrow, this->cells);
+        else WidenCounters<uint16_t, uint32_t>(this->filter, narrow, this->cells);
+        ::operator delete[](narrow, std::align_val_t(CBF::BLOCK_SIZE));
+
+        this->cell_size = cell_size;
+        this->cell_bits = 8 * cell_size;
+        this->size = this->cells * cell_size;
+        this->SelectKernels();
+
+        // The overflows are recorded again by IncrementCell, for the amount
+        // exceeding the wider counters
+        std::vector<std::pair<uint64_t, long long> > overflown = this->overflows.Sorted();
+        this->overflows.Clear();
+        for (const auto &cell : overflown) {
+            long long amount = cell.second;
+            while (amount > 0) {
+                int step = (int) std::min(amount, (long long) INT_MAX);
+                (this->*set_cell)(cell.first, step);
+                amount -= step;
+            }
+        }
+    }
+
+
+    // Widens the counters of an adaptive filter once any of them overflowed,
+    // to the narrowest native counters that hold them all (see
+    // CBFConfig::adaptive). Filters with 4 bytes counters keep their
+    // overflows.
+    void CBF::PromoteCells() {
+        if (this->cell_size == 4 || this->overflows.Cells() == 0) return;
+
+        long long largest = 0;
+        for (const auto &cell : this->overflows.Sorted()) largest = std::max(largest, cell.second);
+
+        this->WidenCells(this->cell_size == 1 && this->cell_max + largest <= 65535 ? 2 : 4);
+    }
+
+
+    // Runs the Merge kernel of this adaptive filter against the narrower
+    // counters of the other one, which are read through their own width
+    void CBF::MergeNarrower(const CBF &other) {
+        if (this->cell_size == 2) this->MergeKernel<Cells16, Cells8>(other);
+        else if (other.cell_size == 1) this->MergeKernel<Cells32, Cells8>(other);
+        else this->MergeKernel<Cells32, Cells16>(other);
+    }
+
+
+    // Runs the Intersect kernel of this adaptive filter against the narrower
+    // counters of the other one (see MergeNarrower)
+    void CBF::IntersectNarrower(const CBF &other) {
+        if (this->cell_size == 2) this->IntersectKernel<Cells16, Cells8>(other);
+        else if (other.cell_size == 1) this->IntersectKernel<Cells32, Cells8>(other);
+        else this->IntersectKernel<Cells32, Cells16>(other);
+    }
+
+
 /* ***************************** PUBLIC METHODS ***************************** */
 
 
@@ -210,44 +1088,43 @@ namespace cbf {
 
         printf("HASH details:\n");
         printf("Hash family: %d\n", this->HASH_family);
-        printf("Number of hash runs: %d\n\n", this->HASH_number);
+        printf("Number of hash runs: %d\n", this->HASH_number);
+        printf("Index mode: %d\n", this->INDEX_mode);
+        printf("Conservative update: %d\n\n", this->conservative_update);
 
         printf("Filter details:\n");
-        printf("Number of cells: %d\n", this->cells);
-        printf("Size in Bytes: %d\n", this->size);
+        printf("Layout: %d\n", this->LAYOUT_mode);
+        printf("Number of cells: %llu\n", (unsigned long long) this->cells);
+        printf("Cell size in bits: %d%s\n", this->cell_bits, this->adaptive ? " (adaptive)" : "");
+        printf("Size in Bytes: %llu\n", (unsigned long long) this->size);
         printf("Filter sparsity: %.5f\n", this->GetFilterSparsity());
         printf("Filter a-priori fpp: %.5f\n", this->GetFilterAPrioriFpp());
         printf("Filter fpp: %.5f\n", this->GetFilterFpp());
-        printf("Number of mapped elements: %d\n", this->members);
-        printf("Number of unique elements: %d\n", this->unique_members);
+        printf("Number of mapped elements: %lld\n", this->GetMembers());
+        printf("Number of unique elements: %lld\n", this->GetUniqueMembers());
         printf("Cell a-priori overflow probability: %Le\n", this->GetCellAPrioriOverflow());
-        printf("Number of overflows: %d\n", this->GetOverallOverflows());
-        printf("Number of overflown cells: %d\n", this->GetOverflownCells());
+        printf("Number of overflows: %lld\n", this->GetOverallOverflows());
+        printf("Number of overflown cells: %lld\n", this->GetOverflownCells());
+        if (this->multilayer) {
+            printf("Number of upper layers: %d\n", this->GetLayers());
+            for (int l = 1; l <= this->GetLayers(); l++) {
+                printf("Layer %d size in Bytes: %lld\n", l, this->GetLayerMemory(l));
+            }
+        }
 
         if (mode == 1) {
             printf("\nFilter cells content:");
-            for (int i = 0; i < this->size; i += this->cell_size) {
+            for (uint64_t i = 0; i < this->cells; i++) {
                 // For readability purposes, we print a line break after 32 cells
-                if (i % (32 * this->cell_size) == 0)printf("\n");
-                switch (this->cell_size) {
-                    case 1:
-                        std::cout << (unsigned int) (filter[i]) << "|";
-                        break;
-                    case 2:
-                        unsigned long value;
-                        value = (filter[i] << 8) | (filter[i + 1]);
-                        std::cout << (unsigned int) value << "|";
-                        break;
-                    default:
-                        break;
-                }
+                if (i % 32 == 0)printf("\n");
+                std::cout << (unsigned int) this->GetCell(i) << "|";
             }
             printf("\n\n");
         } else printf("\n");
 
         /*std::cout << "Overflows:" << std::endl;
-        for (int i = 0; i < this->cells; i++) {
-            std::cout << "Cell " << i << ": " << this->overflows[i] << std::endl;
+        for (auto const &overflow: this->overflows.Sorted()) {
+            std::cout << "Cell " << overflow.first << ": " << overflow.second << std::endl;
         }*/
 
         printf("\n");
@@ -255,11 +1132,18 @@ namespace cbf {
 
 
     // Prints the filter and related statistics onto a CSV file (path)
+    // mode: 2    writes the whole filter in the binary format, which can be
+    //            loaded back by the CBF(path) constructor (see SaveBinary)
     // mode: 1    writes CBF metadata (CSV: key;value)
     // mode: 0    writes CBF cells (CSV: value)
     void CBF::SaveToDisk(const std::string &path, int mode) {
         std::ofstream myfile;
 
+        if (mode == 2) {
+            this->SaveBinary(path);
+            return;
+        }
+
         myfile.open(path.c_str());
 
         myfile.setf(std::ios_base::fixed, std::ios_base::floatfield);
@@ -269,15 +1153,27 @@ namespace cbf {
 
             myfile << "hash_family" << ";" << this->HASH_family << std::endl;
             myfile << "hash_number" << ";" << this->HASH_number << std::endl;
+            myfile << "index_mode" << ";" << this->INDEX_mode << std::endl;
             myfile << "max_multiplicity" << ";" << this->MULTIPLICITY_max << std::endl;
             myfile << "bit_mapping" << ";" << this->bit_mapping << std::endl;
+            myfile << "layout" << ";" << this->LAYOUT_mode << std::endl;
             myfile << "cells_number" << ";" << this->cells << std::endl;
             myfile << "cell_size" << ";" << this->cell_size << std::endl;
+            myfile << "cell_bits" << ";" << this->cell_bits << std::endl;
             myfile << "byte_size" << ";" << this->size << std::endl;
-            myfile << "members" << ";" << this->members << std::endl;
-            myfile << "unique_members" << ";" << this->unique_members << std::endl;
+            myfile << "members" << ";" << this->GetMembers() << std::endl;
+            myfile << "unique_members" << ";" << this->GetUniqueMembers() << std::endl;
             myfile << "overflows" << ";" << this->GetOverallOverflows() << std::endl;
             myfile << "overflown_cells" << ";" << this->GetOverflownCells() << std::endl;
+            myfile << "multilayer" << ";" << this->multilayer << std::endl;
+            myfile << "conservative_update" << ";" << this->conservative_update << std::endl;
+            myfile << "adaptive" << ";" << this->adaptive << std::endl;
+            if (this->multilayer) {
+                myfile << "layers" << ";" << this->GetLayers() << std::endl;
+                for (int l = 1; l <= this->GetLayers(); l++) {
+                    myfile << "layer_" << l << "_byte_size" << ";" << this->GetLayerMemory(l) << std::endl;
+                }
+            }
             myfile << "sparsity" << ";" << this->GetFilterSparsity() << std::endl;
             myfile << "a-priori fpp" << ";" << this->GetFilterAPrioriFpp() << std::endl;
             myfile << "fpp" << ";" << this->GetFilterFpp() << std::endl;
@@ -289,23 +1185,13 @@ namespace cbf {
             myfile.setf(std::ios_base::fixed, std::ios_base::floatfield);
             myfile.precision(5);
 
-            for (int i = 0; i < this->cells; i++) {
-                myfile << "overflows_" << i << ";" << this->overflows[i] << std::endl;
+            // Only overflown cells are listed
+            for (auto const &overflow: this->overflows.Sorted()) {
+                myfile << "overflows_" << overflow.first << ";" << overflow.second << std::endl;
             }
         } else {
-            for (int i = 0; i < this->size; i += this->cell_size) {
-                switch (this->cell_size) {
-                    case 1:
-                        myfile << (unsigned int) (filter[i]) << std::endl;
-                        break;
-                    case 2:
-                        unsigned long value;
-                        value = (filter[i] << 8) | (filter[i + 1]);
-                        myfile << (unsigned int) value << std::endl;
-                        break;
-                    default:
-                        break;
-                }
+            for (uint64_t i = 0; i < this->cells; i++) {
+                myfile << (unsigned int) this->GetCell(i) << std::endl;
             }
         }
 
@@ -313,6 +1199,515 @@ namespace cbf {
     }
 
 
+    // Frees the memory allocated for the filter and the hash salts
+    void CBF::FreeMemory() {
+#ifdef CBF_MMAP
+        if (this->mapping != nullptr) munmap(this->mapping, this->mapping_size);
+        else ::operator delete[](this->filter, std::align_val_t(CBF::BLOCK_SIZE));
+#else
+        ::operator delete[](this->filter, std::align_val_t(CBF::BLOCK_SIZE));
+#endif
+        for (int j = 0; j < this->HASH_number; j++) {
+            delete[] this->HASH_salt[j];
+        }
+        delete[] this->HASH_salt;
+    }
+
+
+    // Allocates the filter array, with its cells set to 0, as selected by the
+    // allocation, huge_pages and numa fields of the configuration. The array
+    // is aligned to the block size, so that each block of the LAYOUT_BLOCKED
+    // layout is a cache line. Packed counters are accessed 4 bytes at a
+    // time, so the array is padded past its end.
+    // With ALLOC_LAZY the array is an anonymous mapping, whose pages are
+    // zeroed by the OS at their first access, and which can be backed by
+    // huge pages and placed on NUMA nodes before any page is touched. On
+    // platforms without mmap, ALLOC_LAZY falls back to ALLOC_EAGER and the
+    // huge pages and NUMA placement are ignored.
+    void CBF::AllocateFilter(const CBFConfig &config) {
+        size_t length = (size_t) this->size + CBF::FILTER_PADDING;
+
+#ifdef CBF_MMAP
+        if (config.allocation == CBF::ALLOC_LAZY) {
+            void *base = MAP_FAILED;
+
+            // Mappings of huge pages must be a whole number of pages
+            if (config.huge_pages != CBF::HUGE_PAGES_NONE) {
+                length = (length + CBF::HUGE_PAGE_SIZE - 1) / CBF::HUGE_PAGE_SIZE * CBF::HUGE_PAGE_SIZE;
+            }
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+            if (config.huge_pages == CBF::HUGE_PAGES_EXPLICIT) {
+                base = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+            }
+#endif
+            bool explicit_pages = base != MAP_FAILED;
+            if (!explicit_pages) {
+                base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            }
+            if (base == MAP_FAILED) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+            if (config.huge_pages != CBF::HUGE_PAGES_NONE && !explicit_pages) madvise(base, length, MADV_HUGEPAGE);
+#endif
+
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+            if (config.numa != CBF::NUMA_DEFAULT) {
+                // The policies of linux/mempolicy.h, called through syscall
+                // so that libnuma is not required
+                const int MPOL_BIND_POLICY = 2, MPOL_INTERLEAVE_POLICY = 3, MPOL_F_MEMS_ALLOWED_FLAG = 1 << 2;
+                const unsigned long MAX_NODES = 1024;
+                unsigned long nodes[MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+                const int node_bits = 8 * sizeof(unsigned long);
+
+                // The nodes this process may allocate memory on
+                if (syscall(SYS_get_mempolicy, nullptr, nodes, MAX_NODES, nullptr, MPOL_F_MEMS_ALLOWED_FLAG) != 0) {
+                    munmap(base, length);
+                    throw std::runtime_error("Unable to read the NUMA nodes.");
+                }
+                int policy = MPOL_INTERLEAVE_POLICY;
+                if (config.numa == CBF::NUMA_BIND) {
+                    int node = config.numa_node;
+                    if (node < 0 || node >= (int) MAX_NODES || !(nodes[node / node_bits] >> (node % node_bits) & 1)) {
+                        munmap(base, length);
+                        throw std::invalid_argument("Invalid NUMA node.");
+                    }
+                    memset(nodes, 0, sizeof(nodes));
+                    nodes[node / node_bits] = 1UL << (node % node_bits);
+                    policy = MPOL_BIND_POLICY;
+                }
+                if (syscall(SYS_mbind, base, length, policy, nodes, MAX_NODES, 0) != 0) {
+                    munmap(base, length);
+                    throw std::runtime_error("Unable to place the filter on the NUMA nodes.");
+                }
+            }
+#endif
+
+            this->mapping = base;
+            this->mapping_size = length;
+            this->filter = static_cast<BYTE *>(base);
+            return;
+        }
+#endif
+
+        this->filter = new (std::align_val_t(CBF::BLOCK_SIZE)) BYTE[length];
+        memset(this->filter, 0, length);
+    }
+
+
+    // Writes the lowest 'bytes' bytes of value in little endian order
+    static void StoreLittleEndian(unsigned char *p, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            p[i] = (unsigned char) (value >> (8 * i));
+        }
+    }
+
+    // Reads a 'bytes' bytes little endian value
+    static uint64_t LoadLittleEndian(const unsigned char *p, int bytes) {
+        uint64_t value = 0;
+        for (int i = bytes - 1; i >= 0; i--) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    // Reverses the byte order of each 'cell_size' bytes counter, converting
+    // native counters between big and little endian
+    static void SwapCounters(unsigned char *p, uint64_t n, int cell_size) {
+        if (cell_size <= 1) return;
+        for (uint64_t i = 0; i + cell_size <= n; i += cell_size) {
+            std::reverse(p + i, p + i + cell_size);
+        }
+    }
+
+    // The magic number at the start of filter files
+    static const unsigned char FILE_MAGIC[8] = { 'l', 'i', 'b', 'C', 'B', 'F', '\r', '\n' };
+
+
+    // Writes the header of a filter file. All the integers are little
+    // endian. The layout is:
+    // offset  bytes  field
+    // 0       8      magic number "libCBF\r\n"
+    // 8       4      version
+    // 12      4      header size
+    // 16      4x8    bit_mapping, HASH_family, HASH_number, INDEX_mode,
+    //                LAYOUT_mode, cell_size, cell_bits, MULTIPLICITY_max
+    // 48      4      flags (1: multilayer, 2: overflows tracked,
+    //                4: conservative update, 8: adaptive counters)
+    // 56      8x7    cells, size in bytes, members, unique_members,
+    //                non-zero cells, salts offset, counters offset
+    // 112     8x2    overflows offset, number of overflown cells
+    // 128     8x3    salts, counters and overflows checksums
+    // 248     8      checksum of the previous bytes of the header
+    void CBF::EncodeHeader(const FileHeader &header, unsigned char *bytes) {
+        memset(bytes, 0, CBF::FILE_HEADER_SIZE);
+        memcpy(bytes, FILE_MAGIC, sizeof(FILE_MAGIC));
+        StoreLittleEndian(bytes + 8, header.version, 4);
+        StoreLittleEndian(bytes + 12, CBF::FILE_HEADER_SIZE, 4);
+        StoreLittleEndian(bytes + 16, header.bit_mapping, 4);
+        StoreLittleEndian(bytes + 20, header.HASH_family, 4);
+        StoreLittleEndian(bytes + 24, header.HASH_number, 4);
+        StoreLittleEndian(bytes + 28, header.INDEX_mode, 4);
+        StoreLittleEndian(bytes + 32, header.LAYOUT_mode, 4);
+        StoreLittleEndian(bytes + 36, header.cell_size, 4);
+        StoreLittleEndian(bytes + 40, header.cell_bits, 4);
+        StoreLittleEndian(bytes + 44, header.MULTIPLICITY_max, 4);
+        StoreLittleEndian(bytes + 48, header.flags, 4);
+        StoreLittleEndian(bytes + 56, header.cells, 8);
+        StoreLittleEndian(bytes + 64, header.size, 8);
+        StoreLittleEndian(bytes + 72, (uint64_t) header.members, 8);
+        StoreLittleEndian(bytes + 80, (uint64_t) header.unique_members, 8);
+        StoreLittleEndian(bytes + 88, header.nonzero_cells, 8);
+        StoreLittleEndian(bytes + 96, header.salts_offset, 8);
+        StoreLittleEndian(bytes + 104, header.counters_offset, 8);
+        StoreLittleEndian(bytes + 112, header.overflows_offset, 8);
+        StoreLittleEndian(bytes + 120, header.overflow_count, 8);
+        StoreLittleEndian(bytes + 128, header.salts_checksum, 8);
+        StoreLittleEndian(bytes + 136, header.counters_checksum, 8);
+        StoreLittleEndian(bytes + 144, header.overflows_checksum, 8);
+        StoreLittleEndian(bytes + 248, cbf::xxh64(bytes, 248, 0), 8);
+    }
+
+
+    // Reads the header of a filter file (see EncodeHeader), and throws
+    // std::runtime_error if it is not a filter file of a supported version
+    // or if the header is corrupted
+    CBF::FileHeader CBF::DecodeHeader(const unsigned char *bytes) {
+        FileHeader header;
+
+        if (memcmp(bytes, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) throw std::runtime_error("Not a filter file.");
+        header.version = (uint32_t) LoadLittleEndian(bytes + 8, 4);
+        if (header.version > CBF::FILE_VERSION) throw std::runtime_error("Unsupported filter file version.");
+        if (LoadLittleEndian(bytes + 12, 4) != CBF::FILE_HEADER_SIZE ||
+            LoadLittleEndian(bytes + 248, 8) != cbf::xxh64(bytes, 248, 0)) {
+            throw std::runtime_error("Corrupted filter file header.");
+        }
+
+        header.bit_mapping = (int) LoadLittleEndian(bytes + 16, 4);
+        header.HASH_family = (int) LoadLittleEndian(bytes + 20, 4);
+        header.HASH_number = (int) LoadLittleEndian(bytes + 24, 4);
+        header.INDEX_mode = (int) LoadLittleEndian(bytes + 28, 4);
+        header.LAYOUT_mode = (int) LoadLittleEndian(bytes + 32, 4);
+        header.cell_size = (int) LoadLittleEndian(bytes + 36, 4);
+        header.cell_bits = (int) LoadLittleEndian(bytes + 40, 4);
+        header.MULTIPLICITY_max = (int) LoadLittleEndian(bytes + 44, 4);
+        header.flags = (uint32_t) LoadLittleEndian(bytes + 48, 4);
+        header.cells = LoadLittleEndian(bytes + 56, 8);
+        header.size = LoadLittleEndian(bytes + 64, 8);
+        header.members = (long long) LoadLittleEndian(bytes + 72, 8);
+        header.unique_members = (long long) LoadLittleEndian(bytes + 80, 8);
+        header.nonzero_cells = LoadLittleEndian(bytes + 88, 8);
+        header.salts_offset = LoadLittleEndian(bytes + 96, 8);
+        header.counters_offset = LoadLittleEndian(bytes + 104, 8);
+        header.overflows_offset = LoadLittleEndian(bytes + 112, 8);
+        header.overflow_count = LoadLittleEndian(bytes + 120, 8);
+        header.salts_checksum = LoadLittleEndian(bytes + 128, 8);
+        header.counters_checksum = LoadLittleEndian(bytes + 136, 8);
+        header.overflows_checksum = LoadLittleEndian(bytes + 144, 8);
+
+        return header;
+    }
+
+
+    // Returns the checksum of n bytes, chained to the checksum of the
+    // previous ones: the xxHash64 of each CHECKSUM_CHUNK bytes is seeded with
+    // the checksum of the previous chunks. Sections read or written in pieces
+    // that are multiples of CHECKSUM_CHUNK have the same checksum.
+    uint64_t CBF::Checksum(const unsigned char *data, uint64_t n, uint64_t checksum) {
+        for (uint64_t i = 0; i < n; i += CBF::CHECKSUM_CHUNK) {
+            checksum = cbf::xxh64(data + i, std::min(n - i, (uint64_t) CBF::CHECKSUM_CHUNK), checksum);
+        }
+        return checksum;
+    }
+
+
+    // Returns the configuration of a filter with the header in input
+    CBFConfig CBF::HeaderConfig(const FileHeader &header) const {
+        CBFConfig config;
+        if (header.cell_size > 0) config.forced_cell_size = header.cell_size;
+        else config.cell_bits = header.cell_bits;
+        config.cells = header.cells;
+        config.index_mode = header.INDEX_mode;
+        config.layout = header.LAYOUT_mode;
+        config.multilayer = (header.flags & 1) != 0;
+        config.track_overflows = (header.flags & 2) != 0;
+        config.conservative_update = (header.flags & 4) != 0;
+        config.adaptive = (header.flags & 8) != 0;
+        return config;
+    }
+
+
+    // Writes the filter to a binary file (see SaveToDisk), made of the header
+    // (see EncodeHeader), the hash salts, the counters (native counters are
+    // written in little endian) and the overflown cells, each as an 8 bytes
+    // cell index and an 8 bytes amount. Counters are written IO_CHUNK bytes
+    // at a time.
+    void CBF::SaveBinary(const std::string &path) const {
+        FileHeader header;
+        header.version = CBF::FILE_VERSION;
+        header.bit_mapping = this->bit_mapping;
+        header.HASH_family = this->HASH_family;
+        header.HASH_number = this->HASH_number;
+        header.INDEX_mode = this->INDEX_mode;
+        header.LAYOUT_mode = this->LAYOUT_mode;
+        header.cell_size = this->cell_size;
+        header.cell_bits = this->cell_bits;
+        header.MULTIPLICITY_max = this->MULTIPLICITY_max;
+        header.flags = (this->multilayer ? 1 : 0) | (this->track_overflows ? 2 : 0)
+                | (this->conservative_update ? 4 : 0) | (this->adaptive ? 8 : 0);
+        header.cells = this->cells;
+        header.size = this->size;
+        header.members = this->GetMembers();
+        header.unique_members = this->GetUniqueMembers();
+        header.nonzero_cells = this->NonZeroCells();
+
+        // Salts
+        std::vector<unsigned char> salts((size_t) this->HASH_number * CBF::MAX_INPUT_SIZE);
+        for (int j = 0; j < this->HASH_number; j++) {
+            memcpy(&salts[(size_t) j * CBF::MAX_INPUT_SIZE], this->HASH_salt[j], CBF::MAX_INPUT_SIZE);
+        }
+        header.salts_offset = CBF::FILE_HEADER_SIZE;
+        header.salts_checksum = CBF::Checksum(salts.data(), salts.size(), 0);
+
+        // Overflown cells (spilled cells, in a multilayer CBF)
+        std::vector<std::pair<uint64_t, long long> > overflown;
+        if (this->multilayer) {
+            for (uint64_t i = 0; i < this->cells; i++) {
+                if (this->GetCell(i) == this->cell_max && this->layers.Get(i) > 0) {
+                    overflown.emplace_back(i, this->layers.Get(i));
+                }
+            }
+        } else {
+            std::shared_lock<std::shared_mutex> lock(this->overflow_mutex, std::defer_lock);
+            if (this->concurrent) lock.lock();
+            overflown = this->overflows.Sorted();
+        }
+        std::vector<unsigned char> overflows_section(overflown.size() * 16);
+        for (size_t i = 0; i < overflown.size(); i++) {
+            StoreLittleEndian(&overflows_section[i * 16], overflown[i].first, 8);
+            StoreLittleEndian(&overflows_section[i * 16 + 8], (uint64_t) overflown[i].second, 8);
+        }
+        header.overflow_count = overflown.size();
+        header.overflows_checksum = CBF::Checksum(overflows_section.data(), overflows_section.size(), 0);
+
+        header.counters_offset = header.salts_offset + salts.size();
+        header.counters_offset = (header.counters_offset + CBF::COUNTERS_ALIGNMENT - 1) / CBF::COUNTERS_ALIGNMENT * CBF::COUNTERS_ALIGNMENT;
+        // The counters are followed by FILTER_PADDING zero bytes, so that
+        // they can be mapped in memory and read as the filter array
+        header.overflows_offset = header.counters_offset + header.size + CBF::FILTER_PADDING;
+
+        std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) throw std::runtime_error("Unable to open the filter file " + path);
+
+        // The header is written last, once the counters checksum is known
+        std::vector<unsigned char> padding(header.counters_offset - header.salts_offset - salts.size() + CBF::FILTER_PADDING, 0);
+        unsigned char header_bytes[CBF::FILE_HEADER_SIZE] = { 0 };
+        file.write(reinterpret_cast<const char *>(header_bytes), CBF::FILE_HEADER_SIZE);
+        file.write(reinterpret_cast<const char *>(salts.data()), salts.size());
+        file.write(reinterpret_cast<const char *>(padding.data()), header.counters_offset - header.salts_offset - salts.size());
+
+        std::vector<unsigned char> swapped;
+        uint64_t checksum = 0;
+        for (uint64_t offset = 0; offset < header.size; offset += CBF::IO_CHUNK) {
+            uint64_t n = std::min(header.size - offset, (uint64_t) CBF::IO_CHUNK);
+            const unsigned char *chunk = this->filter + offset;
+            if (this->BIG_end && this->cell_size > 1) {
+                swapped.assign(chunk, chunk + n);
+                SwapCounters(swapped.data(), n, this->cell_size);
+                chunk = swapped.data();
+            }
+            checksum = CBF::Checksum(chunk, n, checksum);
+            file.write(reinterpret_cast<const char *>(chunk), n);
+        }
+        header.counters_checksum = checksum;
+
+        file.write(reinterpret_cast<const char *>(padding.data()), CBF::FILTER_PADDING);
+        file.write(reinterpret_cast<const char *>(overflows_section.data()), overflows_section.size());
+
+        CBF::EncodeHeader(header, header_bytes);
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(header_bytes), CBF::FILE_HEADER_SIZE);
+
+        file.close();
+        if (file.fail()) throw std::runtime_error("Unable to write the filter file " + path);
+    }
+
+
+    // Loads a filter written by SaveBinary, checking the checksum of each
+    // section. Counters are read directly into the filter array, IO_CHUNK
+    // bytes at a time. Throws std::runtime_error if the file cannot be read
+    // or is corrupted.
+    void CBF::LoadFromDisk(const std::string &path) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file.is_open()) throw std::runtime_error("Unable to open the filter file " + path);
+
+        unsigned char header_bytes[CBF::FILE_HEADER_SIZE];
+        if (!file.read(reinterpret_cast<char *>(header_bytes), CBF::FILE_HEADER_SIZE)) {
+            throw std::runtime_error("Truncated filter file.");
+        }
+        FileHeader header = CBF::DecodeHeader(header_bytes);
+
+        this->Init(header.bit_mapping, header.HASH_family, header.HASH_number, header.MULTIPLICITY_max,
+                   this->HeaderConfig(header));
+
+        try {
+            if (header.cells != this->cells || header.size != this->size) {
+                throw std::runtime_error("Inconsistent filter file header.");
+            }
+
+            // Salts
+            std::vector<unsigned char> salts((size_t) this->HASH_number * CBF::MAX_INPUT_SIZE);
+            file.seekg(header.salts_offset);
+            if (!file.read(reinterpret_cast<char *>(salts.data()), salts.size())) {
+                throw std::runtime_error("Truncated filter file.");
+            }
+            if (CBF::Checksum(salts.data(), salts.size(), 0) != header.salts_checksum) {
+                throw std::runtime_error("Corrupted filter file salts.");
+            }
+            for (int j = 0; j < this->HASH_number; j++) {
+                memcpy(this->HASH_salt[j], &salts[(size_t) j * CBF::MAX_INPUT_SIZE], CBF::MAX_INPUT_SIZE);
+            }
+
+            // Counters
+            uint64_t checksum = 0;
+            file.seekg(header.counters_offset);
+            for (uint64_t offset = 0; offset < header.size; offset += CBF::IO_CHUNK) {
+                uint64_t n = std::min(header.size - offset, (uint64_t) CBF::IO_CHUNK);
+                unsigned char *chunk = this->filter + offset;
+                if (!file.read(reinterpret_cast<char *>(chunk), n)) throw std::runtime_error("Truncated filter file.");
+                checksum = CBF::Checksum(chunk, n, checksum);
+                if (this->BIG_end) SwapCounters(chunk, n, this->cell_size);
+            }
+            if (checksum != header.counters_checksum) throw std::runtime_error("Corrupted filter file counters.");
+
+            // Overflown cells
+            std::vector<unsigned char> overflows_section(header.overflow_count * 16);
+            file.seekg(header.overflows_offset);
+            if (!file.read(reinterpret_cast<char *>(overflows_section.data()), overflows_section.size())) {
+                throw std::runtime_error("Truncated filter file.");
+            }
+            if (CBF::Checksum(overflows_section.data(), overflows_section.size(), 0) != header.overflows_checksum) {
+                throw std::runtime_error("Corrupted filter file overflows.");
+            }
+            for (uint64_t i = 0; i < header.overflow_count; i++) {
+                uint64_t index = LoadLittleEndian(&overflows_section[i * 16], 8);
+                long long amount = (long long) LoadLittleEndian(&overflows_section[i * 16 + 8], 8);
+                if (index >= this->cells) throw std::runtime_error("Corrupted filter file overflows.");
+                this->AddExcess(index, amount);
+            }
+        } catch (...) {
+            this->FreeMemory();
+            throw;
+        }
+
+        this->members = header.members;
+        this->unique_members = header.unique_members;
+        this->RecountCells();
+    }
+
+
+    // Maps a filter written by SaveBinary in memory, read-only: the counters
+    // are not copied, and Check reads them from the mapped file, so that the
+    // processes mapping the same file share the same pages of the page cache.
+    // The header and the salts are checked, not the counters, which would
+    // read the whole file. The statistics of the blocked layout are computed
+    // at their first use.
+    // int mapping  a combination of the MAPPING_* hints
+    // Throws std::runtime_error if the file cannot be mapped or is corrupted.
+    void CBF::MapFromDisk(const std::string &path, int mapping) {
+#ifdef CBF_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Unable to open the filter file " + path);
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size < CBF::FILE_HEADER_SIZE) {
+            close(fd);
+            throw std::runtime_error("Truncated filter file.");
+        }
+        size_t length = (size_t) file_stat.st_size;
+
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (mapping & CBF::MAPPING_POPULATE) flags |= MAP_POPULATE;
+#endif
+        void *base = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("Unable to map the filter file " + path);
+        const unsigned char *bytes = static_cast<const unsigned char *>(base);
+
+        FileHeader header;
+        try {
+            header = CBF::DecodeHeader(bytes);
+
+            // Native counters are stored in little endian, and a big endian
+            // machine can only read them from a copy (see LoadFromDisk)
+            if (cbf::is_big_endian() && header.cell_size > 1) {
+                throw std::runtime_error("Filter files with multi-byte counters cannot be mapped on big endian machines.");
+            }
+            if (header.counters_offset % CBF::COUNTERS_ALIGNMENT != 0 ||
+                header.salts_offset + (uint64_t) header.HASH_number * CBF::MAX_INPUT_SIZE > length ||
+                header.counters_offset + header.size + CBF::FILTER_PADDING > header.overflows_offset ||
+                header.overflows_offset + header.overflow_count * 16 > length) {
+                throw std::runtime_error("Truncated filter file.");
+            }
+
+            this->Init(header.bit_mapping, header.HASH_family, header.HASH_number, header.MULTIPLICITY_max,
+                       this->HeaderConfig(header), false);
+        } catch (...) {
+            munmap(base, length);
+            throw;
+        }
+
+        this->mapping = base;
+        this->mapping_size = length;
+        this->filter = static_cast<BYTE *>(base) + header.counters_offset;
+
+        try {
+            if (header.cells != this->cells || header.size != this->size) {
+                throw std::runtime_error("Inconsistent filter file header.");
+            }
+
+            // Salts
+            const unsigned char *salts = bytes + header.salts_offset;
+            if (CBF::Checksum(salts, (uint64_t) this->HASH_number * CBF::MAX_INPUT_SIZE, 0) != header.salts_checksum) {
+                throw std::runtime_error("Corrupted filter file salts.");
+            }
+            for (int j = 0; j < this->HASH_number; j++) {
+                memcpy(this->HASH_salt[j], salts + (size_t) j * CBF::MAX_INPUT_SIZE, CBF::MAX_INPUT_SIZE);
+            }
+
+            // Overflown cells, which are few, are copied
+            const unsigned char *overflows_section = bytes + header.overflows_offset;
+            if (CBF::Checksum(overflows_section, header.overflow_count * 16, 0) != header.overflows_checksum) {
+                throw std::runtime_error("Corrupted filter file overflows.");
+            }
+            for (uint64_t i = 0; i < header.overflow_count; i++) {
+                uint64_t index = LoadLittleEndian(overflows_section + i * 16, 8);
+                long long amount = (long long) LoadLittleEndian(overflows_section + i * 16 + 8, 8);
+                if (index >= this->cells) throw std::runtime_error("Corrupted filter file overflows.");
+                this->AddExcess(index, amount);
+            }
+        } catch (...) {
+            this->FreeMemory();
+            throw;
+        }
+
+        // Hints on the way the counters will be accessed
+        if (mapping & CBF::MAPPING_WILLNEED) madvise(base, length, MADV_WILLNEED);
+        if (mapping & CBF::MAPPING_RANDOM) madvise(base, length, MADV_RANDOM);
+
+        this->read_only = true;
+        this->members = header.members;
+        this->unique_members = header.unique_members;
+        this->nonzero_cells = header.nonzero_cells;
+        this->stats_deferred = this->LAYOUT_mode == CBF::LAYOUT_BLOCKED;
+#else
+        (void) mapping;
+        throw std::runtime_error("Memory mapped filters are not supported on this platform.");
+#endif
+    }
+
+
     // Maps a single element (passed as a char array) to the CBF. For each hash
     // function, internal method SetCell is called, passing elements coupled with
     // its multiplicity.
@@ -320,119 +1715,463 @@ namespace cbf {
     // int size         length of the element
     // int multiplicity the element multiplicity
     void CBF::Insert(const char *string, const int size, const int multiplicity) {
-        char *buffer = new char[size];
+        if (size < 0) throw std::invalid_argument("Invalid element size.");
 
-        // We allow a maximum CBF mapping of 32 bit (resulting in 2^32 cells).
-        // Thus, the hash digest is limited to the first four bytes.
-        unsigned char digest32[CBF::MAX_BYTE_MAPPING];
+        this->Insert(std::string_view(string, size), multiplicity);
+    }
 
-        unsigned char *digest = new unsigned char[this->HASH_digest_length];
+    // Maps a single element (passed as a string view) to the CBF. Elements of
+    // any length are accepted, and no memory is allocated.
+    // std::string_view element the element to be mapped
+    // int multiplicity         the element multiplicity
+    void CBF::Insert(std::string_view element, const int multiplicity) {
+        uint64_t indices[CBF::MAX_HASH_NUMBER];
 
-        // Computes the hash digest of the input 'HASH_number' times; each
-        // iteration combines the input char array with a different hash salt
-        for (int k = 0; k < this->HASH_number; k++) {
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
 
-            for (int j = 0; j < size; j++) {
-                buffer[j] = (char) (string[j] ^ this->HASH_salt[k][j]);
+        // Computes the 'HASH_number' cell indices of the input (see
+        // ComputeIndices for the way they are derived)
+        for (int k = 0; k < this->HASH_number;) {
+            k += this->ComputeIndices(element, indices, k);
+        }
+
+        (this->*insert_kernel)(indices, multiplicity);
+        if (this->adaptive) this->PromoteCells();
+
+        this->AddMembers(1, multiplicity);
+    }
+
+    // Maps a batch of elements to the CBF, as Insert does for each of them.
+    // The elements are processed BATCH_SIZE at a time: the cell indices of
+    // all of them are computed and their cells prefetched first, so that
+    // the cache misses of the whole batch overlap, and then their cells are
+    // incremented.
+    // std::string_view *elements the elements to be mapped
+    // size_t count               the number of elements
+    // int *multiplicities        the multiplicity of each element
+    void CBF::InsertBatch(const std::string_view *elements, size_t count, const int *multiplicities) {
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+        std::vector<uint64_t> indices((size_t) CBF::BATCH_SIZE * this->HASH_number);
+
+        for (size_t first = 0; first < count; first += CBF::BATCH_SIZE) {
+            size_t batch = std::min(count - first, (size_t) CBF::BATCH_SIZE);
+
+            for (size_t i = 0; i < batch; i++) {
+                uint64_t *element_indices = &indices[i * this->HASH_number];
+                for (int k = 0; k < this->HASH_number;) {
+                    k += this->ComputeIndices(elements[first + i], element_indices, k);
+                }
+                for (int k = 0; k < this->HASH_number; k++) {
+                    this->PrefetchCell(element_indices[k], true);
+                }
             }
 
-            this->Hash(buffer, size, (unsigned char *) digest);
+            for (size_t i = 0; i < batch; i++) {
+                (this->*insert_kernel)(&indices[i * this->HASH_number], multiplicities[first + i]);
+                if (this->adaptive) this->PromoteCells();
 
-            // Truncates the digest after the first 32 bits (see above)
-            for (int i = 0; i < CBF::MAX_BYTE_MAPPING; i++) {
-                digest32[i] = digest[i];
+                this->AddMembers(1, multiplicities[first + i]);
             }
+        }
+    }
 
-            // Copies the truncated digest (one byte at a time) in an integer
-            // variable (endian independent)
-            unsigned int digest_index;
-            if (this->BIG_end) {
-                digest_index = (digest32[0] << 24) | (digest32[1] << 16) | (digest32[2] << 8) | digest32[3];
-            } else {
-                digest_index = (digest32[3] << 24) | (digest32[2] << 16) | (digest32[1] << 8) | digest32[0];
+    // Maps a chunk of elements to the CBF with the given number of threads.
+    // The filter is split into shards, ranges of cells owned by a single
+    // thread at a time. Each thread first computes the cell indices of a part
+    // of the elements and buckets the increments by shard. Then each thread
+    // applies the increments of the shards it owns, taking the buckets in
+    // the order of the elements. Even and odd shards are updated one after
+    // the other, as packed counters at the edges of neighbouring shards may
+    // share bytes. Each cell goes through the same increments as in a
+    // sequential build, so the filter is the same. The amounts exceeding
+    // saturated counters are recorded last, by a single thread.
+    // buckets holds the increments, and is kept by the caller across chunks
+    // so that its memory is reused.
+    void CBF::BulkInsertChunk(const std::string_view *elements, const int *multiplicities, size_t count,
+                              int threads, std::vector<std::vector<CellUpdate> > &buckets) {
+        long long members = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (multiplicities[i] < 0) {
+                std::string error_message = "Multiplicity must be in [0, ";
+                error_message += std::to_string(CBF::MAX_MULTIPLICITY);
+                error_message += "]\n";
+                throw std::invalid_argument(error_message);
+            }
+            members += multiplicities[i];
+        }
+
+        // Conservative updates depend on the counters left by the previous
+        // elements, so they cannot be sharded: the chunk is inserted in order
+        if (this->conservative_update) {
+            this->InsertBatch(elements, count, multiplicities);
+            return;
+        }
+
+        // Shards are ranges of 2^shard_shift cells, at least 64, and there
+        // are up to 2 * threads of them
+        int target = 1;
+        while (target < 2 * threads && this->cells / (target * 2) >= 64) target *= 2;
+        int shard_shift = 0;
+        while ((this->cells - 1) >> shard_shift >= (uint64_t) target) shard_shift++;
+        int shards = (int) ((this->cells - 1) >> shard_shift) + 1;
+
+        buckets.resize((size_t) threads * shards);
+        for (auto &bucket : buckets) bucket.clear();
+        std::vector<std::vector<CellUpdate> > excess(shards);
+        std::vector<std::thread> workers;
+
+        // Computes the cell indices, each thread those of a contiguous part
+        // of the elements
+        const size_t part = (count + threads - 1) / threads;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                uint64_t indices[CBF::MAX_HASH_NUMBER];
+                std::vector<CellUpdate> *own = &buckets[(size_t) t * shards];
+                size_t last = std::min(count, (t + 1) * part);
+
+                for (size_t i = t * part; i < last; i++) {
+                    for (int k = 0; k < this->HASH_number;) {
+                        k += this->ComputeIndices(elements[i], indices, k);
+                    }
+                    for (int k = 0; k < this->HASH_number; k++) {
+                        own[indices[k] >> shard_shift].push_back({indices[k], multiplicities[i]});
+                    }
+                }
+            });
+        }
+        for (auto &worker : workers) worker.join();
+        workers.clear();
+
+        // Applies the increments, shard by shard
+        for (int parity = 0; parity < 2; parity++) {
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t, parity]() {
+                    for (int s = parity + 2 * t; s < shards; s += 2 * threads) {
+                        for (int owner = 0; owner < threads; owner++) {
+                            (this->*bulk_kernel)(buckets[(size_t) owner * shards + s], excess[s]);
+                        }
+                    }
+                });
             }
+            for (auto &worker : workers) worker.join();
+            workers.clear();
+        }
 
+        // Records the amounts exceeding saturated counters
+        for (const auto &shard_excess : excess) {
+            for (const CellUpdate &update : shard_excess) {
+                this->AddExcess(update.index, update.multiplicity);
+            }
+        }
+        if (this->adaptive) this->PromoteCells();
 
-            // Shifts bits in order to preserve only the first 'bit_mapping'
-            // least significant bits
-            digest_index >>= (CBF::MAX_BIT_MAPPING - this->bit_mapping);
+        this->AddMembers((long long) count, members);
+    }
 
-            this->SetCell(digest_index, multiplicity);
+    // Maps an array of elements to the CBF, sharding the work across the
+    // given number of threads (see BulkInsertChunk). The resulting filter is
+    // the same as the one built by inserting the elements one by one. The
+    // elements are processed BULK_CHUNK at a time, and the statistics of the
+    // filter are recounted at the end. No other thread may update the filter
+    // meanwhile.
+    // std::string_view *elements the elements to be mapped
+    // int *multiplicities        the multiplicity of each element
+    // size_t count               the number of elements
+    // int threads                the number of threads
+    // Returns the statistics of the insertion (see BulkStats).
+    BulkStats CBF::BulkInsert(const std::string_view *elements, const int *multiplicities, size_t count,
+                              int threads) {
+        if (threads <= 0) throw std::invalid_argument("Invalid number of threads.");
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<CellUpdate> > buckets;
+
+        for (size_t first = 0; first < count; first += CBF::BULK_CHUNK) {
+            size_t chunk = std::min(count - first, (size_t) CBF::BULK_CHUNK);
+            this->BulkInsertChunk(elements + first, multiplicities + first, chunk, threads, buckets);
         }
+        this->RecountCells();
+
+        BulkStats stats;
+        stats.elements = count;
+        stats.threads = threads;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.throughput = stats.seconds > 0 ? count / stats.seconds : 0;
+        return stats;
+    }
 
-        this->unique_members++;
-        this->members += multiplicity;
+    // Maps the elements of a dataset file to the CBF (see above). The file
+    // holds one element per line, in the format of the test application:
+    // multiplicity,element
+    // const std::string& path the path of the dataset
+    // int threads             the number of threads
+    // Returns the statistics of the insertion (see BulkStats), reading the
+    // file included.
+    BulkStats CBF::BulkInsert(const std::string &path, int threads) {
+        if (threads <= 0) throw std::invalid_argument("Invalid number of threads.");
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<char> buffer(1 << 20);
+        std::ifstream dataset;
+        dataset.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        dataset.open(path.c_str());
+        if (!dataset.is_open()) throw std::invalid_argument("Unable to open the dataset.");
+
+        std::vector<std::vector<CellUpdate> > buckets;
+        std::vector<std::string> lines(CBF::BULK_CHUNK);
+        std::vector<std::string_view> elements(CBF::BULK_CHUNK);
+        std::vector<int> multiplicities(CBF::BULK_CHUNK);
+        size_t count = 0;
+
+        for (;;) {
+            size_t chunk = 0;
+            while (chunk < (size_t) CBF::BULK_CHUNK && getline(dataset, lines[chunk])) {
+                const std::string &line = lines[chunk];
+                size_t delimiter = line.find(',');
+                if (delimiter == std::string::npos) throw std::invalid_argument("Invalid dataset line: " + line);
+
+                multiplicities[chunk] = atoi(line.c_str());
+                elements[chunk] = std::string_view(line).substr(delimiter + 1);
+                chunk++;
+            }
+            if (chunk == 0) break;
 
-        delete[] buffer;
-        delete[] digest;
+            this->BulkInsertChunk(elements.data(), multiplicities.data(), chunk, threads, buckets);
+            count += chunk;
+        }
+        this->RecountCells();
+
+        BulkStats stats;
+        stats.elements = count;
+        stats.threads = threads;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.throughput = stats.seconds > 0 ? count / stats.seconds : 0;
+        return stats;
     }
 
-    // Verifies weather the input element belongs to the set.
-    // Returns the counter (i.e. the minimum cell number) if the element belongs to a set, 0 otherwise.
-    // char *string     the element to be verified
+    // Adds the elements of the other filter to this one: the counter of each
+    // cell becomes the sum of the counters of the two filters, as if the
+    // elements of the other filter had been inserted in this one. Counters
+    // saturate, and the exceeding amounts (and the overflows of the other
+    // filter) are recorded as overflows. The filters must be compatible:
+    // same bit mapping, hash family, hash number, index mode, layout, hash
+    // salts and cell size. No other thread may update the filter meanwhile.
+    // Adaptive filters may differ in cell size: this filter is widened to
+    // the counters of a wider filter, and reads those of a narrower one
+    // through their own width.
+    // const CBF& other the filter to be merged
+    void CBF::Merge(const CBF &other) {
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+        this->CheckCompatible(other);
+        if (this->adaptive && other.adaptive && other.cell_size > this->cell_size) this->WidenCells(other.cell_size);
+
+        if (other.cell_size == this->cell_size) (this->*merge_kernel)(other);
+        else this->MergeNarrower(other);
+        if (this->adaptive) this->PromoteCells();
+
+        this->AddMembers(other.GetUniqueMembers(), other.GetMembers());
+        this->RecountCells();
+    }
+
+    // Intersects this filter with the other one: the counter of each cell
+    // becomes the minimum of the counters of the two filters, overflows
+    // included. The filters must be compatible, and adaptive filters of
+    // different cell sizes are reconciled (see Merge). The members counters
+    // become the minimum of those of the two filters, an upper bound of the
+    // members of the intersection.
+    // const CBF& other the filter to be intersected
+    void CBF::Intersect(const CBF &other) {
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+        this->CheckCompatible(other);
+        if (this->adaptive && other.adaptive && other.cell_size > this->cell_size) this->WidenCells(other.cell_size);
+
+        if (other.cell_size == this->cell_size) (this->*intersect_kernel)(other);
+        else this->IntersectNarrower(other);
+
+        long long unique_members = std::min(this->GetUniqueMembers(), other.GetUniqueMembers());
+        long long members = std::min(this->GetMembers(), other.GetMembers());
+        this->AddMembers(unique_members - this->GetUniqueMembers(), members - this->GetMembers());
+        this->RecountCells();
+    }
+
+    // Removes a single element (passed as a char array) from the CBF,
+    // decrementing its cells by its multiplicity.
+    // char *string     element to be removed
     // int size         length of the element
-    int CBF::Check(const char *string, const int size) const {
-        std::vector<char> buffer(size);
-        int counter = INT_MAX;
-        int current_counter = 0;
+    // int multiplicity the multiplicity the element was mapped with (or
+    //                  part of it)
+    // Throws std::underflow_error, leaving the filter unchanged, if any cell
+    // of the element would go below 0.
+    // A partial removal only lowers the members counter: the element leaves
+    // the unique members once its counter (see Check) reaches 0.
+    void CBF::Remove(const char *string, const int size, const int multiplicity) {
+        if (size < 0) throw std::invalid_argument("Invalid element size.");
+
+        this->Remove(std::string_view(string, size), multiplicity);
+    }
 
-        // We allow a maximum CBF mapping of 32 bit (resulting in 2^32 cells).
-        // Thus, the hash digest is limited to the first four bytes.
-        unsigned char digest32[CBF::MAX_BYTE_MAPPING];
+    // Removes a single element (passed as a string view) from the CBF (see
+    // above).
+    // std::string_view element the element to be removed
+    // int multiplicity         see above
+    void CBF::Remove(std::string_view element, const int multiplicity) {
+        uint64_t indices[CBF::MAX_HASH_NUMBER];
+
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+        // Counters of a concurrent CBF only grow
+        if (this->concurrent) throw std::logic_error("Elements cannot be removed from a concurrent filter.");
+        // Conservative counters do not hold the multiplicities of the
+        // elements mapped to them, which removal would take away
+        if (this->conservative_update) throw std::logic_error("Elements cannot be removed from a conservative update filter.");
+
+        if (multiplicity < 0) {
+            std::string error_message = "Multiplicity must be in [0, ";
+            error_message += std::to_string(CBF::MAX_MULTIPLICITY);
+            error_message += "]\n";
+            throw std::invalid_argument(error_message);
+        }
 
-        std::vector<unsigned char> digest(this->HASH_digest_length);
+        for (int k = 0; k < this->HASH_number;) {
+            k += this->ComputeIndices(element, indices, k);
+        }
 
-        // Computes the hash digest of the input 'HASH_number' times; each
-        // iteration combines the input char array with a different hash salt
-        for (int k = 0; k < this->HASH_number; k++) {
+        (this->*remove_kernel)(indices, multiplicity);
 
-            for (int j = 0; j < size; j++) {
-                buffer[j] = (char) (string[j] ^ this->HASH_salt[k][j]);
-            }
+        const bool removed = multiplicity > 0 && (this->*resolve_kernel)(indices, true) == 0;
+        this->AddMembers(removed ? -1 : 0, -multiplicity);
+    }
+
+    // Verifies weather the input element belongs to the set.
+    // Returns the counter (i.e. the minimum cell number) if the element belongs to a set, 0 otherwise.
+    // char *string        the element to be verified
+    // int size            length of the element
+    // bool with_overflows if set, adds the overflows of saturated cells back to
+    //                     their counters, so that the returned counter is exact
+    //                     even above the cell limit (counters are capped at INT_MAX)
+    int CBF::Check(const char *string, const int size, bool with_overflows) const {
+        if (size < 0) throw std::invalid_argument("Invalid element size.");
+
+        return this->Check(std::string_view(string, size), with_overflows);
+    }
 
-            this->Hash(buffer.data(), size, digest.data());
+    // Verifies weather the input element (passed as a string view) belongs to
+    // the set. Elements of any length are accepted, and no memory is allocated.
+    // std::string_view element the element to be verified
+    // bool with_overflows      see above
+    int CBF::Check(std::string_view element, bool with_overflows) const {
+        return (this->*check_kernel)(element, with_overflows);
+    }
 
-            // Truncates the digest to the first 32 bits
-            for (int i = 0; i < CBF::MAX_BYTE_MAPPING; i++) {
-                digest32[i] = digest[i];
+    // Verifies a batch of elements, as Check does for each of them (see
+    // InsertBatch for the way batches are processed). Where AVX2 is available
+    // the counters of the cells of an element are gathered together.
+    // std::string_view *elements the elements to be verified
+    // size_t count               the number of elements
+    // int *counters              receives the counter of each element
+    // bool with_overflows        see Check
+    void CBF::CheckBatch(const std::string_view *elements, size_t count, int *counters,
+                         bool with_overflows) const {
+        std::vector<uint64_t> indices((size_t) CBF::BATCH_SIZE * this->HASH_number);
+
+        for (size_t first = 0; first < count; first += CBF::BATCH_SIZE) {
+            size_t batch = std::min(count - first, (size_t) CBF::BATCH_SIZE);
+
+            for (size_t i = 0; i < batch; i++) {
+                uint64_t *element_indices = &indices[i * this->HASH_number];
+                for (int k = 0; k < this->HASH_number;) {
+                    k += this->ComputeIndices(elements[first + i], element_indices, k);
+                }
+                for (int k = 0; k < this->HASH_number; k++) {
+                    this->PrefetchCell(element_indices[k], false);
+                }
             }
 
-            // Copies the truncated digest (one byte at a time) in an integer
-            // variable (endian independent)
-            unsigned int digest_index;
-            if (this->BIG_end) {
-                digest_index = (digest32[0] << 24) | (digest32[1] << 16) | (digest32[2] << 8) | digest32[3];
-            } else {
-                digest_index = (digest32[3] << 24) | (digest32[2] << 16) | (digest32[1] << 8) | digest32[0];
+            for (size_t i = 0; i < batch; i++) {
+                counters[first + i] = (this->*resolve_kernel)(&indices[i * this->HASH_number], with_overflows);
             }
+        }
+    }
 
-            // Shifts bits in order to preserve only the first 'bit_mapping' least
-            // significant bits
-            digest_index >>= (CBF::MAX_BIT_MAPPING - this->bit_mapping);
-
-            current_counter = this->GetCell(digest_index);
-
-            counter = std::min(counter, current_counter);
-            // If one hash points to an empty cell, the element does not belong
-            // to any set.
-            if (counter == 0) break;
+    // Returns the overall multiplicity of the mapped elements
+    long long CBF::GetMembers() const {
+        long long members = this->members;
+        if (this->concurrent) {
+            for (int i = 0; i < CBF::MEMBER_STRIPES; i++) {
+                members += this->member_stripes[i].members.load(std::memory_order_relaxed);
+            }
         }
+        return members;
+    }
 
-        return counter;
+    // Returns the number of mapped elements
+    long long CBF::GetUniqueMembers() const {
+        long long unique_members = this->unique_members;
+        if (this->concurrent) {
+            for (int i = 0; i < CBF::MEMBER_STRIPES; i++) {
+                unique_members += this->member_stripes[i].unique_members.load(std::memory_order_relaxed);
+            }
+        }
+        return unique_members;
     }
 
     // Returns the sparsity of the entire CBF
     float CBF::GetFilterSparsity() const {
-        float ret;
-        int e = 0;
-        for (int i = 1; i < this->cells; i++) {
-            if (this->GetCell(i) != 0) {
-                e++;
+        return (float) ((double) this->NonZeroCells() / (double) this->cells);
+    }
+
+
+    // Recomputes the statistics kept at each insertion (the number of non-zero
+    // cells of the filter and of each block) with a full scan of the filter.
+    // The statistics are always up to date, so the scan is only needed after
+    // the filter array is changed directly. It must not run while other
+    // threads insert into a concurrent CBF. Cells are counted a block (or,
+    // in the LAYOUT_CLASSIC layout, the whole filter) at a time by the count
+    // kernel of the counter storage, in a single vectorized pass.
+    void CBF::RecountCells() {
+        if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) {
+            this->nonzero_cells = 0;
+            this->block_fpp_sum = 0;
+            for (size_t b = 0; b < this->block_nonzero.size(); b++) {
+                uint64_t c = this->count_kernel(this->filter, (uint64_t) b * this->block_cells, this->block_cells);
+                this->block_nonzero[b] = (uint16_t) c;
+                this->block_fpp_sum += this->block_fpp[c];
+                this->nonzero_cells += c;
             }
+            return;
         }
-        ret = ((float) e / (float) this->cells);
 
-        return ret;
+        this->nonzero_cells = this->count_kernel(this->filter, 0, this->cells);
+    }
+
+    // Removes all the elements from the filter: the counters are zeroed in a
+    // single pass over the filter array, and the overflows (or upper layers),
+    // the members counters and the statistics are reset. No other thread may
+    // update the filter meanwhile.
+    // With ALLOC_LAZY the pages of the filter array are released instead
+    // (on Linux), so that they are zeroed by the OS at their next access and
+    // no memory is committed meanwhile.
+    void CBF::Clear() {
+        if (this->read_only) throw std::logic_error("The filter is read-only.");
+
+#if defined(CBF_MMAP) && defined(__linux__)
+        if (this->mapping == nullptr || madvise(this->mapping, this->mapping_size, MADV_DONTNEED) != 0) {
+            memset(this->filter, 0, this->size);
+        }
+#else
+        memset(this->filter, 0, this->size);
+#endif
+        this->overflows.Clear();
+        this->layers.Clear();
+
+        this->members = 0;
+        this->unique_members = 0;
+        if (this->concurrent) this->member_stripes.reset(new MemberStripe[CBF::MEMBER_STRIPES]);
+
+        this->nonzero_cells = 0;
+        this->block_fpp_sum = 0;
+        std::fill(this->block_nonzero.begin(), this->block_nonzero.end(), 0);
     }
 
     //https://www.geeksforgeeks.org/binomial-coefficient-dp-9/
@@ -455,14 +2194,19 @@ namespace cbf {
 
     // Returns the a-priori overflow probability of a cell
     long double CBF::GetCellAPrioriOverflow() const {
-        int j = 255;
-        if (this->cell_size == 2) {
-            j = 65535;
-        }
+        return CBF::CellOverflowBound(this->cells, this->HASH_number, this->GetMembers(), this->cell_max);
+    }
 
-        int m = this->cells;
-        int k = this->HASH_number;
-        int n = this->members;
+
+    // Returns the bound of Ficara et al. on the probability that a cell of a
+    // filter with the given cells and hash number reaches counter_max, once
+    // 'members' elements (multiplicities included) are mapped to it
+    long double CBF::CellOverflowBound(uint64_t cells, int HASH_number, long long members, int counter_max) {
+        int j = counter_max;
+
+        long double m = (long double) cells;
+        long double k = HASH_number;
+        long double n = (long double) members;
 
         /* Only for testing purpose
          * See: Ficara et al. "Multilayer Compressed Counting Bloom Filters"
@@ -472,11 +2216,11 @@ namespace cbf {
             j = 8;
         */
 
-        int kn = k * n;
+        long double kn = k * n;
 
         long double p = exp(1.0);
-        p *= (long double) kn;
-        p /= (long double) m * j;
+        p *= kn;
+        p /= m * j;
         p = std::pow(p, j);
         return p;
     }
@@ -484,53 +2228,115 @@ namespace cbf {
 
     // Returns the a-priori false positive probability over the entire filter
     float CBF::GetFilterAPrioriFpp() const {
+        return this->GetAPrioriFpp(this->GetUniqueMembers());
+    }
+
+
+    // Returns the a-priori false positive probability over the entire filter,
+    // once 'unique_members' unique elements are mapped to it
+    float CBF::GetAPrioriFpp(long long unique_members) const {
         double p;
 
+        if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) return this->GetFilterBlockedAPrioriFpp(unique_members);
+
         p = (double) (1 - 1 / (double) this->cells);
-        p = (double) (1 - (double) pow(p, this->HASH_number * this->unique_members));
+        p = (double) (1 - (double) pow(p, (double) this->HASH_number * unique_members));
         p = (double) pow(p, this->HASH_number);
 
         return (float) p;
     }
 
 
+    // Returns the a-priori false positive probability of the LAYOUT_BLOCKED
+    // layout. The number of elements mapped to each block follows a Poisson
+    // distribution with mean unique_members/blocks (Putze et al.). Blocks are
+    // small, so the classic (1 - (1 - 1/c)^(k*i))^k approximation of the fpp
+    // of a block holding i elements is too optimistic: the exact value is
+    // computed from the distribution of the number of non-zero cells after
+    // k*i insertions in a block of c cells, updated k cells at a time.
+    // fpp = sum_i Poisson(i) * sum_s P(s non-zero cells | k*i cells set) * (s/c)^k
+    float CBF::GetFilterBlockedAPrioriFpp(long long unique_members) const {
+        const int c = this->block_cells;
+        const double blocks = (double) this->cells / c;
+        const double lambda = (double) unique_members / blocks;
+        // The Poisson probabilities are negligible past this bound
+        const int last = (int) (lambda + 10 * sqrt(lambda) + 10);
+        std::vector<double> occupancy(c + 1, 0.0);
+        double poisson = exp(-lambda);
+        double p = 0;
+
+        occupancy[0] = 1;
+        for (int i = 0; i <= last; i++) {
+            if (i > 0) poisson *= lambda / i;
+
+            double block_fpp = 0;
+            for (int s = 1; s <= c; s++) {
+                block_fpp += occupancy[s] * pow((double) s / c, this->HASH_number);
+            }
+            p += poisson * block_fpp;
+
+            // Maps the k cells of one more element
+            for (int j = 0; j < this->HASH_number; j++) {
+                for (int s = c; s > 0; s--) {
+                    occupancy[s] = occupancy[s] * s / c + occupancy[s - 1] * (c - s + 1) / c;
+                }
+                occupancy[0] = 0;
+            }
+        }
+
+        return (float) p;
+    }
+
+
     // Returns the a-posteriori false positive probability over the entire filter
     float CBF::GetFilterFpp() const {
         double p;
-        int c = 0;
-        // Counts non-zero cells
-        for (int i = 1; i < this->cells; i++) {
-            if (this->GetCell(i) > 0) {
-                c++;
-            }
+
+        if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) {
+            // An element is a false positive if its k cells are non-zero in
+            // the block it is mapped to: averages the fpp of each block
+            p = this->BlockFppSum() / this->block_nonzero.size();
+
+            return (float) p;
         }
-        p = (double) c / (double) this->cells;
+
+        p = (double) this->NonZeroCells() / (double) this->cells;
 
         p = (double) (pow(p, this->HASH_number));
 
         return (float) p;
     }
 
-    // Returns the overall number of overflows
-    int CBF::GetOverallOverflows() const {
-        int total = 0;
-        for (auto const &value: this->overflows) {
-            total += value;
-        }
+    // Returns the overall number of overflows (the amount stored in the upper
+    // layers, in a multilayer CBF)
+    long long CBF::GetOverallOverflows() const {
+        if (this->multilayer) return this->layers.Total();
 
-        return total;
+        std::shared_lock<std::shared_mutex> lock(this->overflow_mutex, std::defer_lock);
+        if (this->concurrent) lock.lock();
+        return this->overflows.Total();
     }
 
     // Returns the number of overflown cells
-    int CBF::GetOverflownCells() const {
-        int total = 0;
-        for (auto const &value: this->overflows) {
-            if (value != 0) {
-                total++;
-            }
-        }
+    long long CBF::GetOverflownCells() const {
+        if (this->multilayer) return (long long) this->layers.SpilledCells();
+
+        std::shared_lock<std::shared_mutex> lock(this->overflow_mutex, std::defer_lock);
+        if (this->concurrent) lock.lock();
+        return (long long) this->overflows.Cells();
+    }
+
+    // Returns the number of upper layers of a multilayer CBF
+    int CBF::GetLayers() const {
+        return this->layers.Layers();
+    }
 
-        return total;
+    // Returns the memory in bytes used by a layer of a multilayer CBF: layer 0
+    // is the filter array, layers 1 to GetLayers() are the upper layers
+    long long CBF::GetLayerMemory(int layer) const {
+        if (layer < 0 || layer > this->GetLayers()) throw std::invalid_argument("Invalid layer.");
+        if (layer == 0) return (long long) this->size;
+        return (long long) this->layers.LayerBytes(layer);
     }
 
 } //namespace cbf
\ No newline at end of file
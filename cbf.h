@@ -37,6 +37,7 @@
 #elif defined(_MSC_VER)
 #define NOMINMAX
 #include <windows.h>
+#include <intrin.h>
 #include "win/libexport.h"
 #define WIN32_LEAN_AND_MEAN
 #elif __GNUC__
@@ -45,12 +46,22 @@
 #endif
 
 #include "end.h"
+#include "multilayer.h"
+#include "overflow.h"
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <math.h>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
 #include <stdio.h>
 #include <string.h>
+#include <string_view>
 #include <vector>
 
 #include "base64.h"
@@ -61,62 +72,401 @@
 namespace cbf {
     long binomialCoeff(int n, int k);
 
+	// Optional construction parameters of the CBF. The defaults reproduce the
+	// behaviour of the original filter.
+	struct CBFConfig {
+		// Forces the size in bytes of each cell (1, 2 or 4). If 0, the size is
+		// derived from MULTIPLICITY_max.
+		int forced_cell_size = 0;
+		// Sets the width in bits of each counter (1 to 16), so that counters
+		// are packed in the filter array. Widths of 8 and 16 bits are stored
+		// as 1 and 2 bytes cells. If 0, forced_cell_size applies.
+		int cell_bits = 0;
+		// Selects how the cell indices of an element are derived from its
+		// digests (see CBF::INDEX_SALTED, CBF::INDEX_DOUBLE_HASHING and
+		// CBF::INDEX_DIGEST_SLICING).
+		int index_mode = 0;
+		// Selects how the cell indices of an element are spread over the
+		// filter (see CBF::LAYOUT_CLASSIC and CBF::LAYOUT_BLOCKED).
+		int layout = 0;
+		// Sets the number of cells of the filter, which need not be a power
+		// of 2: bit_mapping is then ignored. Digests are mapped to the cells
+		// with Lemire's multiply-shift reduction (see CBF::FastRange). In the
+		// LAYOUT_BLOCKED layout the number is rounded up to a whole number of
+		// blocks. If 0, the filter has 2^bit_mapping cells.
+		uint64_t cells = 0;
+		// If set, saturated counters spill into the upper layers of a
+		// multilayer CBF (see MultilayerCounters), so that Check always
+		// returns exact counters while cells stay small.
+		bool multilayer = false;
+		// If set, the amount exceeding saturated counters is recorded as
+		// overflows, so that Remove can decrement saturated cells exactly.
+		// If not set, saturated cells are sticky: Remove leaves them
+		// saturated, as their actual counter is unknown.
+		bool track_overflows = true;
+		// If set, several threads can Insert into and Check the filter at
+		// once, without locks: counters are updated atomically (see
+		// AtomicCells) and the members counters are kept per thread. Only
+		// native counters (1, 2 or 4 bytes cells) are supported, and
+		// elements cannot be removed.
+		bool concurrent = false;
+		// If set, Insert raises each of the cells of an element only as far
+		// as its new counter (the minimum over the cells) requires: cells
+		// already above it are left unchanged (conservative update, or
+		// minimal increase). Counters overestimate far less, but no longer
+		// hold the sum of the multiplicities mapped to them, so elements
+		// cannot be removed. In a concurrent CBF, racing insertions may
+		// raise cells past the minimal increase, never below it.
+		bool conservative_update = false;
+		// If set, the filter starts with 1 byte counters (or with
+		// forced_cell_size) and widens them, to 2 and then 4 bytes, the
+		// first time a counter overflows, so that MULTIPLICITY_max need not
+		// be known in advance. Counters keep their values across widenings,
+		// and adaptive filters of different widths can be merged and
+		// intersected.
+		// Requires native counters, overflow tracking, the LAYOUT_CLASSIC
+		// layout and ALLOC_EAGER, and is not available to multilayer or
+		// concurrent CBFs.
+		bool adaptive = false;
+		// Selects how the filter array is allocated (see CBF::ALLOC_EAGER
+		// and CBF::ALLOC_LAZY).
+		int allocation = 0;
+		// Backs the filter array with 2 MiB pages, which reduce the TLB
+		// misses of random accesses to large filters (see
+		// CBF::HUGE_PAGES_NONE, CBF::HUGE_PAGES_TRANSPARENT and
+		// CBF::HUGE_PAGES_EXPLICIT). Requires ALLOC_LAZY.
+		int huge_pages = 0;
+		// Places the pages of the filter array on the NUMA nodes (see
+		// CBF::NUMA_DEFAULT, CBF::NUMA_INTERLEAVE and CBF::NUMA_BIND).
+		// Requires ALLOC_LAZY.
+		int numa = 0;
+		// The node the filter array is bound to, with NUMA_BIND
+		int numa_node = 0;
+	};
+
+	// Statistics of a bulk insertion (see CBF::BulkInsert)
+	struct BulkStats {
+		// The number of inserted elements
+		size_t elements = 0;
+		// The number of threads the insertion was sharded across
+		int threads = 0;
+		// The elapsed time in seconds (reading the dataset included)
+		double seconds = 0;
+		// The number of elements inserted per second
+		double throughput = 0;
+	};
+
 	// The CBF class implementing the Spatial Bloom FIlters
 	class DLL_PUBLIC CBF
 	{
+		// Windowed CBFs apply the cell indices of an element to their
+		// generations directly, and static CBFs update the counters of the
+		// filter they wrap
+		friend class WindowedCBF;
+		template<typename Counter, typename Hasher, int K> friend class StaticCBF;
 
 	private:
 		BYTE *filter;
 		BYTE ** HASH_salt;
 		int bit_mapping;
-		int cells;
+		uint64_t cells;
 		int cell_size;
-		int size;
+		int cell_bits;
+		int cell_max;
+		uint64_t size;
 		int HASH_family;
 		int HASH_number;
 		int HASH_digest_length;
-		int members;
-        int unique_members;
+		long long members;
+        long long unique_members;
+		// Members counters of a concurrent CBF, one per group of threads,
+		// each on its own cache line so that threads do not contend for it
+		struct alignas(64) MemberStripe {
+			std::atomic<long long> members{0};
+			std::atomic<long long> unique_members{0};
+		};
+		std::unique_ptr<MemberStripe[]> member_stripes;
+		bool concurrent;
+		// Guards the overflows of a concurrent CBF, which are only accessed
+		// when a cell is saturated
+		mutable std::shared_mutex overflow_mutex;
 		int MULTIPLICITY_max;
-		std::vector<int> overflows;
+		OverflowTable overflows;
+		bool multilayer;
+		bool track_overflows;
+		bool conservative_update;
+		bool adaptive;
+		MultilayerCounters layers;
 		int BIG_end;
+		int INDEX_mode;
+		int digest_indices;
+		int slice_bits;
+		int LAYOUT_mode;
+		int block_cells;
+		int block_shift;
+		// Set if the number of cells is a power of 2, whose indices are
+		// the most significant bits of the digests
+		bool is_power_of_2;
+		// Statistics kept up to date at each insertion, so that the stats
+		// getters take a constant time: the number of non-zero cells and, in
+		// the LAYOUT_BLOCKED layout, the number of non-zero cells of each
+		// block and the sum over the blocks of their fpp (see GetFilterFpp)
+		uint64_t nonzero_cells;
+		std::vector<uint16_t> block_nonzero;
+		std::vector<double> block_fpp;
+		double block_fpp_sum;
+		bool stats_deferred = false;
+		mutable std::once_flag stats_once;
+		// The mapping holding the counters, if they are not allocated by
+		// new: the file mapping of a read-only filter (see MapFromDisk) or
+		// the anonymous mapping of ALLOC_LAZY (see AllocateFilter)
+		void *mapping = nullptr;
+		size_t mapping_size = 0;
+		bool read_only = false;
+
+		// Cell accessors and Insert and Check kernels specialized for the
+		// counters of the filter, selected once at construction (see
+		// SelectKernels)
+		void (CBF::*set_cell)(uint64_t index, int multiplicity);
+		int (*get_cell)(const unsigned char *filter, uint64_t index);
+		void (CBF::*insert_kernel)(const uint64_t *indices, int multiplicity);
+		void (CBF::*remove_kernel)(const uint64_t *indices, int multiplicity);
+		int (CBF::*check_kernel)(std::string_view element, bool with_overflows) const;
+		int (CBF::*resolve_kernel)(const uint64_t *indices, bool with_overflows) const;
+		uint64_t (*count_kernel)(const unsigned char *filter, uint64_t first, uint64_t count);
+
+		// An increment of a cell, as sharded by BulkInsert
+		struct CellUpdate {
+			uint64_t index;
+			int multiplicity;
+		};
+		void (CBF::*bulk_kernel)(const std::vector<CellUpdate> &updates, std::vector<CellUpdate> &excess);
+		void (CBF::*merge_kernel)(const CBF &other);
+		void (CBF::*intersect_kernel)(const CBF &other);
+
+		// The header of a filter file (see SaveToDisk)
+		struct FileHeader {
+			uint32_t version;
+			int bit_mapping;
+			int HASH_family;
+			int HASH_number;
+			int INDEX_mode;
+			int LAYOUT_mode;
+			int cell_size;
+			int cell_bits;
+			int MULTIPLICITY_max;
+			uint32_t flags;
+			uint64_t cells;
+			uint64_t size;
+			long long members;
+			long long unique_members;
+			uint64_t nonzero_cells;
+			uint64_t salts_offset;
+			uint64_t counters_offset;
+			uint64_t overflows_offset;
+			uint64_t overflow_count;
+			uint64_t salts_checksum;
+			uint64_t counters_checksum;
+			uint64_t overflows_checksum;
+		};
 
 		// Private methods (commented in the cbf.cpp)
-		void SetCell(unsigned int index, int area);
-		int GetCell(unsigned int index) const;
+		void SetCell(uint64_t index, int area);
+		int GetCell(uint64_t index) const;
+		void PrefetchCell(uint64_t index, bool write) const;
+		void CountNonZeroCell(uint64_t index, int delta);
+		uint64_t NonZeroCells() const;
+		double BlockFppSum() const;
+		void AddOverflow(uint64_t index, long long amount);
+		void AddExcess(uint64_t index, long long amount);
+		void RemoveExcess(uint64_t index, long long amount);
+		void CheckCompatible(const CBF &other) const;
+		long long GetOverflow(uint64_t index) const;
+		void AddMembers(long long elements, long long multiplicity);
+		void WidenCells(int cell_size);
+		void PromoteCells();
+		template<typename Cells> void IncrementCell(uint64_t index, int multiplicity);
+		template<typename Cells> void InsertKernel(const uint64_t *indices, int multiplicity);
+		template<typename Cells> void ConservativeInsertKernel(const uint64_t *indices, int multiplicity);
+		template<typename Cells> void DecrementCell(uint64_t index, int multiplicity);
+		template<typename Cells> void RemoveKernel(const uint64_t *indices, int multiplicity);
+		template<typename Cells> void BulkKernel(const std::vector<CellUpdate> &updates, std::vector<CellUpdate> &excess);
+		template<typename Cells, typename OtherCells = Cells> void MergeKernel(const CBF &other);
+		template<typename Cells, typename OtherCells = Cells> void IntersectKernel(const CBF &other);
+		void MergeNarrower(const CBF &other);
+		void IntersectNarrower(const CBF &other);
+		void BulkInsertChunk(const std::string_view *elements, const int *multiplicities, size_t count,
+		        int threads, std::vector<std::vector<CellUpdate> > &buckets);
+		template<typename Cells> long long CellCounter(uint64_t index, bool with_overflows) const;
+		template<typename Cells> int CheckKernel(std::string_view element, bool with_overflows) const;
+		template<typename Cells, bool GATHER> int ResolveKernel(const uint64_t *indices, bool with_overflows) const;
+		template<typename Cells> void SelectCells();
+		template<int W> void SelectPackedCells();
+		void SelectKernels();
 		void CreateHashSalt(const std::string& path);
 		void LoadHashSalt(const std::string& path);
 		void SetHashDigestLength();
-		void Hash(char *d, size_t n, unsigned char *md) const;
+		void Hash(const char *d, size_t n, int k, unsigned char *md) const;
+		int ComputeIndices(std::string_view element, uint64_t *indices, int first) const;
+		void MapToBlock(uint64_t *indices, int first, int count) const;
+		// Maps the 64-bit word x to [0, range) with Lemire's multiply-shift
+		// reduction (fastrange): the most significant 64 bits of x * range.
+		// Uniform words give uniform indices without a division, and in filters
+		// of 2^b cells the index is made of the b most significant bits of x.
+		static inline uint64_t FastRange(uint64_t x, uint64_t range)
+		{
+#if defined(__SIZEOF_INT128__)
+			return (uint64_t) (((unsigned __int128) x * range) >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+			return __umulh(x, range);
+#else
+			uint64_t x_low = (uint32_t) x, x_high = x >> 32;
+			uint64_t r_low = (uint32_t) range, r_high = range >> 32;
+			uint64_t cross = x_high * r_low + ((x_low * r_low) >> 32);
+			uint64_t cross2 = x_low * r_high + (uint32_t) cross;
+			return x_high * r_high + (cross >> 32) + (cross2 >> 32);
+#endif
+		}
+		float GetFilterBlockedAPrioriFpp(long long unique_members) const;
+		static void EncodeHeader(const FileHeader &header, unsigned char *bytes);
+		static FileHeader DecodeHeader(const unsigned char *bytes);
+		static uint64_t Checksum(const unsigned char *data, uint64_t n, uint64_t checksum);
+		CBFConfig HeaderConfig(const FileHeader &header) const;
+		void SaveBinary(const std::string &path) const;
+		void LoadFromDisk(const std::string &path);
+		void MapFromDisk(const std::string &path, int mapping);
+		void FreeMemory();
+		void AllocateFilter(const CBFConfig &config);
 
 
 	public:
-		// The maximum string (as a char array) length in bytes of each element
-		// given as input to be mapped in the CBF
+		// The length in bytes of each hash salt. Elements longer than this are
+		// combined with the salt repeated over their whole length
 		const static int MAX_INPUT_SIZE = 128;
 		// This value defines the maximum size (as in number of cells) of the CBF:
-		// MAX_BIT_MAPPING = 32 states that the CBF will be composed at most by
-		// 2^32 cells. The value is the number of bits used for CBF indexing.
-		const static int MAX_BIT_MAPPING = 32;
-		// Utility byte value of the above MAX_BIT_MAPPING
-		const static int MAX_BYTE_MAPPING = MAX_BIT_MAPPING / 8;
-		// The maximum value of the counters. This way, we limit the memory size
-		// (which is the memory size of each cell) to 2 bytes
-		const static int MAX_MULTIPLICITY = 65535;
+		// MAX_BIT_MAPPING = 40 states that the CBF will be composed at most by
+		// 2^40 cells. The value is the number of bits used for CBF indexing.
+		const static int MAX_BIT_MAPPING = 40;
+		// Utility byte value of the above MAX_BIT_MAPPING, no longer used by
+		// the library
+		[[deprecated("unused, derive it from MAX_BIT_MAPPING")]] const static int MAX_BYTE_MAPPING = MAX_BIT_MAPPING / 8;
+		// The maximum value of the counters. Counters up to 255 take 1 byte,
+		// up to 65535 2 bytes, and larger counters 4 bytes
+		const static int MAX_MULTIPLICITY = INT_MAX;
 		// The maximum number of allowed digests
 		const static int MAX_HASH_NUMBER = 1024;
 
+		// Index derivation modes.
+		// INDEX_SALTED          the element is combined with a different salt
+		//                       for each of the HASH_number digests, and each
+		//                       digest yields one cell index.
+		// INDEX_DOUBLE_HASHING  a single digest is computed and the cell
+		//                       indices are derived from two of its 32-bit
+		//                       words (Kirsch-Mitzenmacher double hashing).
+		// INDEX_DIGEST_SLICING  each salted digest is cut into as many
+		//                       'bit_mapping' wide indices as it holds, so
+		//                       that fewer digests are computed while indices
+		//                       are still cryptographically derived.
+		const static int INDEX_SALTED = 0;
+		const static int INDEX_DOUBLE_HASHING = 1;
+		const static int INDEX_DIGEST_SLICING = 2;
+
+		// Filter layouts.
+		// LAYOUT_CLASSIC  each index of an element addresses any cell of
+		//                 the filter.
+		// LAYOUT_BLOCKED  the first index of an element selects a block of
+		//                 BLOCK_SIZE bytes (one cache line) and all the
+		//                 indices of the element address cells inside that
+		//                 block, so each Insert/Check touches a single
+		//                 cache line (Putze et al., "Cache-, Hash- and
+		//                 Space-Efficient Bloom Filters").
+		const static int LAYOUT_CLASSIC = 0;
+		const static int LAYOUT_BLOCKED = 1;
+		// The size in bytes of a block of the LAYOUT_BLOCKED layout
+		const static int BLOCK_SIZE = 64;
+		// The number of bytes allocated past the end of the filter array
+		const static int FILTER_PADDING = 4;
+		// The number of elements whose cells are prefetched together by
+		// InsertBatch and CheckBatch
+		const static int BATCH_SIZE = 16;
+		// The number of elements BulkInsert shards at a time
+		const static int BULK_CHUNK = 1 << 20;
+		// The number of members counters of a concurrent CBF
+		const static int MEMBER_STRIPES = 64;
+
+		// Binary filter files (see SaveToDisk).
+		// FILE_VERSION        the version of the format written by SaveToDisk.
+		//                     Files of later versions are not loaded.
+		// FILE_HEADER_SIZE    the size in bytes of the header.
+		// COUNTERS_ALIGNMENT  the counters start at a multiple of this offset,
+		//                     so that they can be mapped in memory.
+		// CHECKSUM_CHUNK      sections are checksummed in chunks of this size.
+		// IO_CHUNK            the size in bytes of each read and write.
+		const static int FILE_VERSION = 1;
+		const static int FILE_HEADER_SIZE = 256;
+		const static int COUNTERS_ALIGNMENT = 4096;
+		const static int CHECKSUM_CHUNK = 1 << 20;
+		const static int IO_CHUNK = 8 << 20;
+
+		// Allocation policies of the filter array (see CBFConfig::allocation)
+		// ALLOC_EAGER  the array is allocated and zeroed at construction
+		// ALLOC_LAZY   the array is mapped from the OS, whose pages are
+		//              zeroed at their first access: construction takes a
+		//              constant time and untouched cells take no memory
+		const static int ALLOC_EAGER = 0;
+		const static int ALLOC_LAZY = 1;
+
+		// Page sizes of the filter array (see CBFConfig::huge_pages)
+		// HUGE_PAGES_NONE         the default pages of the OS
+		// HUGE_PAGES_TRANSPARENT  asks the OS for transparent huge pages,
+		//                         which it may or may not provide
+		// HUGE_PAGES_EXPLICIT     2 MiB pages from the pool reserved by the
+		//                         administrator (vm.nr_hugepages), or
+		//                         transparent ones if the pool is empty
+		const static int HUGE_PAGES_NONE = 0;
+		const static int HUGE_PAGES_TRANSPARENT = 1;
+		const static int HUGE_PAGES_EXPLICIT = 2;
+		const static int HUGE_PAGE_SIZE = 2 << 20;
+
+		// NUMA placement of the filter array (see CBFConfig::numa)
+		// NUMA_DEFAULT     pages are placed on the node of the thread
+		//                  touching them first
+		// NUMA_INTERLEAVE  pages are spread round-robin over the nodes, so
+		//                  that threads on every node see the same latency
+		// NUMA_BIND        pages are placed on CBFConfig::numa_node
+		const static int NUMA_DEFAULT = 0;
+		const static int NUMA_INTERLEAVE = 1;
+		const static int NUMA_BIND = 2;
+
+		// Hints on the way a filter mapped in memory is read (see the
+		// CBF(path, mapping) constructor), which can be combined.
+		// MAPPING_LAZY      pages are read from the file at their first access
+		// MAPPING_POPULATE  pages are read (or mapped from the page cache)
+		//                   when the filter is opened
+		// MAPPING_WILLNEED  pages are read ahead in the background
+		// MAPPING_RANDOM    no read ahead, for filters larger than the memory
+		const static int MAPPING_LAZY = 0;
+		const static int MAPPING_POPULATE = 1;
+		const static int MAPPING_WILLNEED = 2;
+		const static int MAPPING_RANDOM = 4;
+
 		// CBF class constructor
 		// Arguments:
 		// bit_mapping      actual size of the filter (as in number of cells): for
 		//                  instance, bit_mapping = 10 states that the CBF will be
 		//                  composed by 2^10 cells. As such, the size can only be
-		//                  defined as a power of 2. This value is bounded by the
+		//                  defined as a power of 2 (see CBFConfig::cells for
+		//                  other sizes). This value is bounded by the
 		//                  MAX_BIT_MAPPING constant.
 		// HASH_family      specifies the hash function to be used. Currently available:
 		//                  1: SHA1
 		//                  4: MD4
 		//                  5: MD5
+		//                  6: MurmurHash3 (x64, 128 bit)
+		//                  7: xxHash64
+		//                  8: wyhash
+		//                  The last three are non-cryptographic hash functions,
+		//                  seeded with the hash salts.
 		// HASH_number      number of digests to be produced (by running the hash function
 		//                  specified above using different salts) in the insertion and
 		//                  check phases.
@@ -126,32 +476,129 @@ namespace cbf {
 		//                  If the file exists, reads one salt per line.
 		//                  If the file doesn't exist, the salts are randomly generated
 		//                  during the filter creation phase
+		// forced_cell_size forces the size in bytes of each cell (1, 2 or 4)
 		CBF(int bit_mapping, int HASH_family, int HASH_number, int MULTIPLICITY_max,
 		        const std::string& salt_path, int forced_cell_size=0)
+		        : CBF(bit_mapping, HASH_family, HASH_number, MULTIPLICITY_max, salt_path,
+		              MakeConfig(forced_cell_size))
+		{
+		}
+
+		// CBF class constructor taking the optional parameters as a CBFConfig
+		CBF(int bit_mapping, int HASH_family, int HASH_number, int MULTIPLICITY_max,
+		        const std::string& salt_path, const CBFConfig& config)
+		{
+			if (salt_path.length() == 0) throw std::invalid_argument("Invalid hash salt path.");
+
+			this->Init(bit_mapping, HASH_family, HASH_number, MULTIPLICITY_max, config);
+
+			// Creates the hash salts or loads them from the specified file
+			std::ifstream my_file(salt_path.c_str());
+			try {
+				if (my_file.good()) this->LoadHashSalt(salt_path);
+				else this->CreateHashSalt(salt_path);
+			} catch (...) {
+				this->FreeMemory();
+				throw;
+			}
+		}
+
+		// CBF class constructor loading a filter saved by SaveToDisk in the
+		// binary format (mode 2), salts and overflows included
+		// path             path of the filter file
+		explicit CBF(const std::string& path)
+		{
+			this->LoadFromDisk(path);
+		}
+
+		// CBF class constructor mapping a filter saved by SaveToDisk in the
+		// binary format (mode 2) in memory. The filter is read-only: Check
+		// reads the counters from the file, and the processes mapping the
+		// same file share its pages. Insert, Remove and the other updates
+		// throw std::logic_error.
+		// path             path of the filter file
+		// mapping          a combination of the MAPPING_* hints
+		CBF(const std::string& path, int mapping)
 		{
+			this->MapFromDisk(path, mapping);
+		}
+
+		// CBF class destructor
+		~CBF()
+		{
+			this->FreeMemory();
+		}
+
+
+	private:
+		// Initializes an empty filter with the given parameters (see the
+		// constructor). The hash salts are allocated, but not set. Unless
+		// allocate is set, the filter array is left to the caller.
+		void Init(int bit_mapping, int HASH_family, int HASH_number, int MULTIPLICITY_max,
+		        const CBFConfig& config, bool allocate = true)
+		{
+			int forced_cell_size = config.forced_cell_size;
 
 			// Argument validation
-			if (bit_mapping <= 0 || bit_mapping > MAX_BIT_MAPPING) throw std::invalid_argument("Invalid bit mapping.");
+			if (config.cells == 0 && (bit_mapping <= 0 || bit_mapping > MAX_BIT_MAPPING)) throw std::invalid_argument("Invalid bit mapping.");
+			if (config.cells == 1 || config.cells > (1ULL << MAX_BIT_MAPPING)) throw std::invalid_argument("Invalid number of cells.");
 			if (MULTIPLICITY_max <= 0 || MULTIPLICITY_max > MAX_MULTIPLICITY) throw std::invalid_argument("Invalid multipliciy value.");
 			if (HASH_number <= 0 || HASH_number > MAX_HASH_NUMBER) throw std::invalid_argument("Invalid number of hash runs.");
-			if (salt_path.length() == 0) throw std::invalid_argument("Invalid hash salt path.");
+			if (config.index_mode < INDEX_SALTED || config.index_mode > INDEX_DIGEST_SLICING) throw std::invalid_argument("Invalid index mode.");
+			if (config.layout != LAYOUT_CLASSIC && config.layout != LAYOUT_BLOCKED) throw std::invalid_argument("Invalid layout.");
+			if (config.multilayer && !config.track_overflows) throw std::invalid_argument("Multilayer counters require overflow tracking.");
+			if (config.concurrent && config.multilayer) throw std::invalid_argument("Multilayer counters cannot be concurrent.");
+			if (config.adaptive && (config.cell_bits > 0 || config.multilayer || config.concurrent || !config.track_overflows)) {
+			    throw std::invalid_argument("Adaptive counters require native, non concurrent counters with overflow tracking.");
+			}
+			if (config.adaptive && (config.layout != LAYOUT_CLASSIC || config.allocation != ALLOC_EAGER)) {
+			    throw std::invalid_argument("Adaptive counters require LAYOUT_CLASSIC and ALLOC_EAGER.");
+			}
+			if (config.allocation != ALLOC_EAGER && config.allocation != ALLOC_LAZY) throw std::invalid_argument("Invalid allocation.");
+			if (config.huge_pages < HUGE_PAGES_NONE || config.huge_pages > HUGE_PAGES_EXPLICIT) throw std::invalid_argument("Invalid huge pages.");
+			if (config.numa < NUMA_DEFAULT || config.numa > NUMA_BIND) throw std::invalid_argument("Invalid NUMA placement.");
+			if ((config.huge_pages != HUGE_PAGES_NONE || config.numa != NUMA_DEFAULT) && config.allocation != ALLOC_LAZY) {
+			    throw std::invalid_argument("Huge pages and NUMA placement require ALLOC_LAZY.");
+			}
 
 			// Checks whether the execution is being performed on a big endian or little endian machine
 			this->BIG_end = cbf::is_big_endian();
 
 			// Defines the number of bytes required for each cell depending on MULTIPLICITY_max
 			// In order to reduce the memory footprint of the filter, we use 1 byte 
-			// for a maximum multiplicity <= 255, 2 bytes for a up to MAX_MULTIPLICITY
-			if(forced_cell_size > 0) {
-			    if(forced_cell_size > 2) {
-			        throw std::invalid_argument("Forced cell size must be 1 or 2");
+			// for a maximum multiplicity <= 255, 2 bytes for a up to 65535 and
+			// 4 bytes up to MAX_MULTIPLICITY
+			if (config.cell_bits < 0 || config.cell_bits > 16) {
+			    throw std::invalid_argument("Cell bits must be in [1, 16]");
+			}
+			this->cell_bits = 0;
+			if (config.cell_bits == 8 || config.cell_bits == 16) {
+			    this->cell_size = config.cell_bits / 8;
+			} else if (config.cell_bits > 0) {
+			    // Packed counters, which take no whole number of bytes
+			    this->cell_size = 0;
+			    this->cell_bits = config.cell_bits;
+			} else if(forced_cell_size > 0) {
+			    if(forced_cell_size != 1 && forced_cell_size != 2 && forced_cell_size != 4) {
+			        throw std::invalid_argument("Forced cell size must be 1, 2 or 4");
                 }
 
                 this->cell_size = forced_cell_size;
+            } else if (config.adaptive) {
+                // Adaptive counters start narrow (see PromoteCells)
+                this->cell_size = 1;
             } else {
                 if (MULTIPLICITY_max <= 255) this->cell_size = 1;
-                else if (MULTIPLICITY_max > 255) this->cell_size = 2;
+                else if (MULTIPLICITY_max <= 65535) this->cell_size = 2;
+                else this->cell_size = 4;
+			}
+			if (this->cell_size > 0) this->cell_bits = 8 * this->cell_size;
+			if (config.concurrent && this->cell_size == 0) {
+			    throw std::invalid_argument("Packed counters cannot be concurrent.");
 			}
+			this->concurrent = config.concurrent;
+			this->conservative_update = config.conservative_update;
+			this->adaptive = config.adaptive;
 
 
 			// Sets the type of hash function to be used
@@ -159,67 +606,129 @@ namespace cbf {
 			this->SetHashDigestLength();
 			// Sets the number of digests
 			this->HASH_number = HASH_number;
-
-			// Initializes the HASH_salt matrix
-			this->HASH_salt = new BYTE*[HASH_number];
-			for (int j = 0; j<HASH_number; j++) {
-				this->HASH_salt[j] = new BYTE[CBF::MAX_INPUT_SIZE];
+			// Sets the way cell indices are derived from the digests
+			this->INDEX_mode = config.index_mode;
+
+			// Defines the number of cells in the filter. With an arbitrary
+			// number of cells, bit_mapping is the number of bits of the
+			// largest index.
+			if (config.cells > 0) {
+			    bit_mapping = 1;
+			    while ((config.cells - 1) >> bit_mapping) bit_mapping++;
+			    this->cells = config.cells;
+			} else {
+			    this->cells = 1ULL << bit_mapping;
 			}
-
-			// Creates the hash salts or loads them from the specified file
-			std::ifstream my_file(salt_path.c_str());
-			if (my_file.good()) this->LoadHashSalt(salt_path);
-			else this->CreateHashSalt(salt_path);
-
-			// Defines the number of cells in the filter
-			this->cells = (int)pow(2, bit_mapping);
 			this->bit_mapping = bit_mapping;
 
+			// Selects the counter storage and the kernels matching the cell size
+			this->SelectKernels();
+
+			// Defines the number of cells in each block, which must be a power
+			// of 2. Filters smaller than a block are made of a single block.
+			// With packed counters whose width is not a power of 2, blocks
+			// are shorter than BLOCK_SIZE and may span two cache lines.
+			this->LAYOUT_mode = config.layout;
+			this->block_cells = 1;
+			while (this->block_cells * 2 * this->cell_bits <= CBF::BLOCK_SIZE * 8) this->block_cells *= 2;
+			while ((uint64_t) this->block_cells > this->cells) this->block_cells /= 2;
+			this->block_shift = 32;
+			for (int c = this->block_cells; c > 1; c >>= 1) this->block_shift--;
+			if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) {
+			    this->cells = (this->cells + this->block_cells - 1) / this->block_cells * this->block_cells;
+			}
+			this->is_power_of_2 = (this->cells & (this->cells - 1)) == 0;
+
+			// Defines how many indices a single digest holds (used in
+			// INDEX_DIGEST_SLICING mode). Indices of filters whose number of
+			// cells is not a power of 2 are reduced from slices at least 8
+			// bits wider, so that all the cells are equally likely.
+			this->digest_indices = (this->HASH_digest_length * 8) / bit_mapping;
+			this->slice_bits = bit_mapping;
+			if (!this->is_power_of_2) {
+			    this->digest_indices = std::max(1, (this->HASH_digest_length * 8) / (bit_mapping + 8));
+			    this->slice_bits = std::min(56, (this->HASH_digest_length * 8) / this->digest_indices);
+			}
+
 			// Defines the total size in bytes of the filter
-			this->size = this->cell_size*this->cells;
+			this->size = (this->cell_bits * this->cells + 7) / 8;
 
-			// Memory allocation for the CBF array
-			this->filter = new BYTE[this->size];
+			// Memory allocation for the CBF array, whose cells are set to 0
+			// (see AllocateFilter)
+			this->filter = nullptr;
+			if (allocate) this->AllocateFilter(config);
 
-			// Initializes the cells to 0
-			for (int i = 0; i < this->size; i++) {
-				this->filter[i] = 0;
+			// Initializes the HASH_salt matrix
+			this->HASH_salt = new BYTE*[HASH_number];
+			for (int j = 0; j<HASH_number; j++) {
+				this->HASH_salt[j] = new BYTE[CBF::MAX_INPUT_SIZE];
 			}
 
-			// Initializes the overflow counter
-            overflows = std::vector<int>(this->cells, 0);
+			// The upper layers of a multilayer CBF are only allocated when the
+			// first cell spills
+			this->multilayer = config.multilayer;
+			this->track_overflows = config.track_overflows;
+			this->layers = MultilayerCounters(this->cells);
 
             // Initializes the members counters
             this->members = 0;
             this->unique_members = 0;
+            if (this->concurrent) this->member_stripes.reset(new MemberStripe[CBF::MEMBER_STRIPES]);
+
+            // Initializes the statistics of the empty filter. block_fpp[s] is
+            // the fpp of a block with s non-zero cells.
+            this->nonzero_cells = 0;
+            this->block_fpp_sum = 0;
+            if (this->LAYOUT_mode == CBF::LAYOUT_BLOCKED) {
+                this->block_nonzero.assign(this->cells / this->block_cells, 0);
+                for (int s = 0; s <= this->block_cells; s++) {
+                    this->block_fpp.push_back(pow((double) s / this->block_cells, HASH_number));
+                }
+            }
 
 			// Sets the maximum multiplicity found in the construction dataset
 			this->MULTIPLICITY_max = MULTIPLICITY_max;
 		}
 
-		// CBF class destructor
-		~CBF()
-		{
-			// Frees the allocated memory
-			delete[] filter;
-			for (int j = 0; j<this->HASH_number; j++) {
-				delete[] HASH_salt[j];
-			}
-			delete[] HASH_salt;
+	public:
+		// Builds a CBFConfig with the given forced cell size
+		static CBFConfig MakeConfig(int forced_cell_size) {
+			CBFConfig config;
+			config.forced_cell_size = forced_cell_size;
+			return config;
 		}
 
-
 		// Public methods (commented in the cbf.cpp)
 		void PrintFilter(int mode) const;
 		void SaveToDisk(const std::string& path, int mode);
 		void Insert(const char *string, int size, int area);
-		int Check(const char *string, int size) const;
+		void Insert(std::string_view element, int multiplicity);
+		void Merge(const CBF &other);
+		void Intersect(const CBF &other);
+		void Remove(const char *string, int size, int multiplicity);
+		void Remove(std::string_view element, int multiplicity);
+		int Check(const char *string, int size, bool with_overflows = false) const;
+		int Check(std::string_view element, bool with_overflows = false) const;
+		void InsertBatch(const std::string_view *elements, size_t count, const int *multiplicities);
+		void CheckBatch(const std::string_view *elements, size_t count, int *counters,
+		        bool with_overflows = false) const;
+		BulkStats BulkInsert(const std::string_view *elements, const int *multiplicities, size_t count,
+		        int threads);
+		BulkStats BulkInsert(const std::string &path, int threads);
+		long long GetMembers() const;
+		long long GetUniqueMembers() const;
 		float GetFilterSparsity() const;
+		void RecountCells();
+		void Clear();
 		float GetFilterFpp() const;
 		float GetFilterAPrioriFpp() const;
+		float GetAPrioriFpp(long long unique_members) const;
         long double GetCellAPrioriOverflow() const;
-		int GetOverallOverflows() const;
-        int GetOverflownCells() const;
+		static long double CellOverflowBound(uint64_t cells, int HASH_number, long long members, int counter_max);
+		long long GetOverallOverflows() const;
+        long long GetOverflownCells() const;
+		int GetLayers() const;
+		long long GetLayerMemory(int layer) const;
 	};
 
 } //namespace cbf
@@ -29,6 +29,10 @@
 #define CBFLIB_H
 
 #include "cbf.h"
+#include "planner.h"
+#include "scalable.h"
+#include "staticcbf.h"
+#include "windowed.h"
 
 
 #endif /* CBFLIB_H */
\ No newline at end of file
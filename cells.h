@@ -0,0 +1,219 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef CELLS_H
+#define CELLS_H
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <limits>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace cbf {
+
+// Returns the number of set bits of x
+static inline int Popcount64(uint64_t x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+	return (int)__popcnt64(x);
+#else
+	return __builtin_popcountll(x);
+#endif
+}
+
+// Counter storage policies. Each policy defines how the counter of a cell
+// is read from and written to the filter array, so that the Insert and Check
+// kernels of the CBF can be specialized once for each cell size instead of
+// checking the cell size for each cell.
+
+// Counters stored as native integers of type T (uint8_t, uint16_t or
+// uint32_t), in the byte order of the machine. The counters of 4 bytes cells
+// are limited to INT_MAX, so that any counter fits the int values returned
+// by CBF::Check.
+template<typename T>
+struct NativeCells {
+	typedef T Counter;
+
+	// Counters are native integers, which can be gathered by SIMD loads
+	static const bool NATIVE = true;
+	static const int MAX = sizeof(T) < sizeof(int) ? (int)std::numeric_limits<T>::max() : INT_MAX;
+
+	static inline int Get(const unsigned char *filter, uint64_t index) {
+		return (int)reinterpret_cast<const T *>(filter)[index];
+	}
+
+	static inline void Set(unsigned char *filter, uint64_t index, int value) {
+		reinterpret_cast<T *>(filter)[index] = (T)value;
+	}
+
+	// Adds amount (>= 0) to the counter, saturating at MAX, and returns the
+	// previous counter
+	static inline int AddSaturated(unsigned char *filter, uint64_t index, int amount) {
+		int value = Get(filter, index);
+		Set(filter, index, (int)std::min((long long)value + amount, (long long)MAX));
+		return value;
+	}
+
+	// Returns the number of non-zero counters in [first, first + count).
+	// The loop has no branches, so that it is vectorized by the compiler.
+	static uint64_t CountNonZero(const unsigned char *filter, uint64_t first, uint64_t count) {
+		const T *counters = reinterpret_cast<const T *>(filter) + first;
+		uint64_t n = 0;
+		for (uint64_t i = 0; i < count; i++) {
+			n += counters[i] != 0;
+		}
+		return n;
+	}
+};
+
+typedef NativeCells<uint8_t> Cells8;
+typedef NativeCells<uint16_t> Cells16;
+typedef NativeCells<uint32_t> Cells32;
+
+// Counters stored as native integers of type T, as in NativeCells, which are
+// accessed atomically, so that several threads can insert into and check the
+// filter at once. Counters saturate with a compare-and-swap loop, so that no
+// update is lost and each counter only grows: concurrent readers see
+// monotonic counters.
+template<typename T>
+struct AtomicCells {
+	typedef T Counter;
+
+	// Atomic counters are not gathered by (non-atomic) SIMD loads
+	static const bool NATIVE = false;
+	static const int MAX = NativeCells<T>::MAX;
+
+	static inline int Get(const unsigned char *filter, uint64_t index) {
+		T &counter = const_cast<T *>(reinterpret_cast<const T *>(filter))[index];
+		return (int)std::atomic_ref<T>(counter).load(std::memory_order_relaxed);
+	}
+
+	static inline void Set(unsigned char *filter, uint64_t index, int value) {
+		std::atomic_ref<T>(reinterpret_cast<T *>(filter)[index]).store((T)value, std::memory_order_relaxed);
+	}
+
+	// Adds amount (>= 0) to the counter, saturating at MAX, and returns the
+	// previous counter. A plain fetch-add could take the counter past MAX,
+	// where other threads would see it, so a compare-and-swap loop is used.
+	static inline int AddSaturated(unsigned char *filter, uint64_t index, int amount) {
+		std::atomic_ref<T> counter(reinterpret_cast<T *>(filter)[index]);
+		T value = counter.load(std::memory_order_relaxed);
+		T new_value;
+
+		do {
+			new_value = (T)std::min((long long)value + amount, (long long)MAX);
+		} while (!counter.compare_exchange_weak(value, new_value, std::memory_order_relaxed));
+
+		return (int)value;
+	}
+
+	// Counts are only taken while no thread updates the filter
+	static uint64_t CountNonZero(const unsigned char *filter, uint64_t first, uint64_t count) {
+		return NativeCells<T>::CountNonZero(filter, first, count);
+	}
+};
+
+// Counters of W bits (1 <= W <= 16) packed one after the other, so that the
+// counter of cell i takes bits [i*W, (i+1)*W) of the filter array. Bits are
+// numbered in little endian order: bit b is bit (b % 8) of byte (b / 8).
+// Each access reads the 4 bytes holding the counter, so the filter array
+// must be padded with 3 bytes past its end.
+template<int W>
+struct PackedCells {
+	static const bool NATIVE = false;
+	static const int MAX = (1 << W) - 1;
+
+	static inline uint32_t Load(const unsigned char *p) {
+		return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	}
+
+	static inline void Store(unsigned char *p, uint32_t word) {
+		p[0] = (unsigned char)word;
+		p[1] = (unsigned char)(word >> 8);
+		p[2] = (unsigned char)(word >> 16);
+		p[3] = (unsigned char)(word >> 24);
+	}
+
+	static inline int Get(const unsigned char *filter, uint64_t index) {
+		uint64_t bit = index * W;
+		return (int)((Load(filter + (bit >> 3)) >> (bit & 7)) & MAX);
+	}
+
+	static inline void Set(unsigned char *filter, uint64_t index, int value) {
+		uint64_t bit = index * W;
+		unsigned char *p = filter + (bit >> 3);
+		uint32_t word = Load(p);
+		word &= ~((uint32_t)MAX << (bit & 7));
+		word |= (uint32_t)value << (bit & 7);
+		Store(p, word);
+	}
+
+	// Adds amount (>= 0) to the counter, saturating at MAX, and returns the
+	// previous counter
+	static inline int AddSaturated(unsigned char *filter, uint64_t index, int amount) {
+		int value = Get(filter, index);
+		Set(filter, index, (int)std::min((long long)value + amount, (long long)MAX));
+		return value;
+	}
+
+	// Returns the number of non-zero counters in [first, first + count).
+	// When W divides 64, 64 bits (64 / W counters) are tested at a time: the
+	// bits of each counter are OR-ed into its lowest bit and the lowest bits
+	// are counted. Counters never straddle two bytes or, for W = 16, two
+	// aligned 16 bits halves, so the byte order of the word does not matter.
+	static uint64_t CountNonZero(const unsigned char *filter, uint64_t first, uint64_t count) {
+		const uint64_t end = first + count;
+		uint64_t n = 0;
+		uint64_t i = first;
+
+		if (64 % W == 0) {
+			const uint64_t per_word = 64 / W;
+			const uint64_t lowest_bits = ~0ULL / (uint64_t)MAX;
+
+			for (; i < end && i % per_word != 0; i++) n += Get(filter, i) != 0;
+			for (; i + per_word <= end; i += per_word) {
+				uint64_t word;
+				memcpy(&word, filter + i * W / 8, sizeof(word));
+				for (int shift = 1; shift < W; shift <<= 1) word |= word >> shift;
+				n += Popcount64(word & lowest_bits);
+			}
+		}
+		for (; i < end; i++) n += Get(filter, i) != 0;
+
+		return n;
+	}
+};
+
+} //namespace cbf
+
+#endif /* CELLS_H */
@@ -0,0 +1,296 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fasthash.h"
+
+#include <string.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace cbf {
+
+// Input words are loaded natively and swapped on big endian machines
+static inline uint64_t read64(const unsigned char *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint64_t read32(const unsigned char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+// Full 64x64 -> 128 bit multiplication, the low half is written to a and
+// the high half to b
+static inline void mul128(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = *a;
+	r *= *b;
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	*a = _umul128(*a, *b, b);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+
+/* ****************************** MurmurHash3 ****************************** */
+
+static inline uint64_t fmix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+void murmur3_128(const void *key, size_t len, uint64_t seed, unsigned char *out) {
+	const unsigned char *data = (const unsigned char *)key;
+	const size_t nblocks = len / 16;
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	uint64_t h1 = seed;
+	uint64_t h2 = seed;
+
+	// Body
+	for (size_t i = 0; i < nblocks; i++) {
+		uint64_t k1 = read64(data + i * 16);
+		uint64_t k2 = read64(data + i * 16 + 8);
+
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+		h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	// Tail
+	const unsigned char *tail = data + nblocks * 16;
+	uint64_t k1 = 0;
+	uint64_t k2 = 0;
+
+	switch (len & 15) {
+	case 15: k2 ^= ((uint64_t)tail[14]) << 48; // fallthrough
+	case 14: k2 ^= ((uint64_t)tail[13]) << 40; // fallthrough
+	case 13: k2 ^= ((uint64_t)tail[12]) << 32; // fallthrough
+	case 12: k2 ^= ((uint64_t)tail[11]) << 24; // fallthrough
+	case 11: k2 ^= ((uint64_t)tail[10]) << 16; // fallthrough
+	case 10: k2 ^= ((uint64_t)tail[9]) << 8;   // fallthrough
+	case 9:  k2 ^= ((uint64_t)tail[8]);
+		k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+		// fallthrough
+	case 8:  k1 ^= ((uint64_t)tail[7]) << 56;  // fallthrough
+	case 7:  k1 ^= ((uint64_t)tail[6]) << 48;  // fallthrough
+	case 6:  k1 ^= ((uint64_t)tail[5]) << 40;  // fallthrough
+	case 5:  k1 ^= ((uint64_t)tail[4]) << 32;  // fallthrough
+	case 4:  k1 ^= ((uint64_t)tail[3]) << 24;  // fallthrough
+	case 3:  k1 ^= ((uint64_t)tail[2]) << 16;  // fallthrough
+	case 2:  k1 ^= ((uint64_t)tail[1]) << 8;   // fallthrough
+	case 1:  k1 ^= ((uint64_t)tail[0]);
+		k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+	}
+
+	// Finalization
+	h1 ^= (uint64_t)len;
+	h2 ^= (uint64_t)len;
+
+	h1 += h2;
+	h2 += h1;
+
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+
+	h1 += h2;
+	h2 += h1;
+
+	store_le64(out, h1);
+	store_le64(out + 8, h2);
+}
+
+
+/* ********************************* xxHash ******************************** */
+
+static const uint64_t XXH_P1 = 11400714785074694791ULL;
+static const uint64_t XXH_P2 = 14029467366897019727ULL;
+static const uint64_t XXH_P3 = 1609587929392839161ULL;
+static const uint64_t XXH_P4 = 9650029242287828579ULL;
+static const uint64_t XXH_P5 = 2870177450012600261ULL;
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * XXH_P2;
+	acc = rotl64(acc, 31);
+	acc *= XXH_P1;
+	return acc;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+	val = xxh64_round(0, val);
+	acc ^= val;
+	acc = acc * XXH_P1 + XXH_P4;
+	return acc;
+}
+
+uint64_t xxh64(const void *key, size_t len, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *)key;
+	const unsigned char *end = p + len;
+	uint64_t h64;
+
+	if (len >= 32) {
+		const unsigned char *limit = end - 32;
+		uint64_t v1 = seed + XXH_P1 + XXH_P2;
+		uint64_t v2 = seed + XXH_P2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_P1;
+
+		do {
+			v1 = xxh64_round(v1, read64(p)); p += 8;
+			v2 = xxh64_round(v2, read64(p)); p += 8;
+			v3 = xxh64_round(v3, read64(p)); p += 8;
+			v4 = xxh64_round(v4, read64(p)); p += 8;
+		} while (p <= limit);
+
+		h64 = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h64 = xxh64_merge_round(h64, v1);
+		h64 = xxh64_merge_round(h64, v2);
+		h64 = xxh64_merge_round(h64, v3);
+		h64 = xxh64_merge_round(h64, v4);
+	} else {
+		h64 = seed + XXH_P5;
+	}
+
+	h64 += (uint64_t)len;
+
+	while (p + 8 <= end) {
+		h64 ^= xxh64_round(0, read64(p));
+		h64 = rotl64(h64, 27) * XXH_P1 + XXH_P4;
+		p += 8;
+	}
+
+	if (p + 4 <= end) {
+		h64 ^= read32(p) * XXH_P1;
+		h64 = rotl64(h64, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+	}
+
+	while (p < end) {
+		h64 ^= (*p) * XXH_P5;
+		h64 = rotl64(h64, 11) * XXH_P1;
+		p++;
+	}
+
+	// Avalanche
+	h64 ^= h64 >> 33;
+	h64 *= XXH_P2;
+	h64 ^= h64 >> 29;
+	h64 *= XXH_P3;
+	h64 ^= h64 >> 32;
+
+	return h64;
+}
+
+
+/* ********************************* wyhash ******************************** */
+
+static const uint64_t WY_P[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+                                 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+	mul128(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t wyr3(const unsigned char *p, size_t k) {
+	return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+uint64_t wyhash(const void *key, size_t len, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *)key;
+	uint64_t a, b;
+
+	seed ^= wymix(seed ^ WY_P[0], WY_P[1]);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+			b = (read32(p + len - 4) << 32) | read32(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = wyr3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+		if (i >= 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = wymix(read64(p) ^ WY_P[1], read64(p + 8) ^ seed);
+				see1 = wymix(read64(p + 16) ^ WY_P[2], read64(p + 24) ^ see1);
+				see2 = wymix(read64(p + 32) ^ WY_P[3], read64(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i >= 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wymix(read64(p) ^ WY_P[1], read64(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = read64(p + i - 16);
+		b = read64(p + i - 8);
+	}
+
+	a ^= WY_P[1];
+	b ^= seed;
+	mul128(&a, &b);
+	return wymix(a ^ WY_P[0] ^ len, b ^ WY_P[1]);
+}
+
+} //namespace cbf
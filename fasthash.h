@@ -0,0 +1,66 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef FASTHASH_H
+#define FASTHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace cbf {
+
+// Non-cryptographic hash functions used by the CBF when speed matters more
+// than collision resistance. All of them take a 64-bit seed, which the CBF
+// derives from its hash salts. Input words are read, and digests written, in
+// little endian order, so that digests do not depend on the byte order of
+// the machine.
+
+// Reads and writes 64-bit words in little endian order
+static inline uint64_t load_le64(const unsigned char *p) {
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+	return v;
+}
+
+static inline void store_le64(unsigned char *p, uint64_t v) {
+	for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// MurmurHash3 x64 128-bit variant (Austin Appleby, public domain).
+// Writes the 16 bytes digest to out.
+void murmur3_128(const void *key, size_t len, uint64_t seed, unsigned char *out);
+
+// xxHash 64-bit variant (Yann Collet, BSD 2-Clause).
+uint64_t xxh64(const void *key, size_t len, uint64_t seed);
+
+// wyhash final version 4 (Wang Yi, public domain).
+uint64_t wyhash(const void *key, size_t len, uint64_t seed);
+
+} //namespace cbf
+
+#endif /* FASTHASH_H */
@@ -0,0 +1,408 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multilayer.h"
+#include "cells.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cbf {
+
+
+/* ******************************* RankBitmap ****************************** */
+
+bool MultilayerCounters::RankBitmap::Test(uint64_t position) const {
+	return (this->words[position >> 6] >> (position & 63)) & 1;
+}
+
+void MultilayerCounters::RankBitmap::Set(uint64_t position) {
+	if (this->Test(position)) return;
+	this->words[position >> 6] |= 1ULL << (position & 63);
+	this->AddToTree(position / RANK_BITS, 1);
+}
+
+void MultilayerCounters::RankBitmap::Clear(uint64_t position) {
+	if (!this->Test(position)) return;
+	this->words[position >> 6] &= ~(1ULL << (position & 63));
+	this->AddToTree(position / RANK_BITS, -1);
+}
+
+void MultilayerCounters::RankBitmap::Resize(uint64_t bits) {
+	this->bits = bits;
+	this->words.assign((bits + 63) / 64, 0);
+	this->Rebuild();
+}
+
+// Returns the number of set bits before the position
+uint64_t MultilayerCounters::RankBitmap::Rank(uint64_t position) const {
+	const uint64_t block = position / RANK_BITS;
+	uint64_t rank = 0;
+
+	// Set bits of the blocks before the one holding the position
+	for (uint64_t i = block; i > 0; i -= i & (~i + 1)) {
+		rank += this->tree[i];
+	}
+
+	// Set bits of the block before the position
+	for (uint64_t w = block * (RANK_BITS / 64); w < (position >> 6); w++) {
+		rank += Popcount64(this->words[w]);
+	}
+	if (position & 63) {
+		rank += Popcount64(this->words[position >> 6] & ((1ULL << (position & 63)) - 1));
+	}
+
+	return rank;
+}
+
+size_t MultilayerCounters::RankBitmap::Bytes() const {
+	return (this->words.size() + this->tree.size()) * sizeof(uint64_t);
+}
+
+void MultilayerCounters::RankBitmap::AddToTree(uint64_t block, long long amount) {
+	for (uint64_t i = block + 1; i < this->tree.size(); i += i & (~i + 1)) {
+		this->tree[i] += amount;
+	}
+}
+
+// Rebuilds the Fenwick tree of the block counts in linear time
+void MultilayerCounters::RankBitmap::Rebuild() {
+	const uint64_t blocks = (this->bits + RANK_BITS - 1) / RANK_BITS;
+	const uint64_t words_per_block = RANK_BITS / 64;
+
+	this->tree.assign(blocks + 1, 0);
+	for (uint64_t w = 0; w < this->words.size(); w++) {
+		this->tree[w / words_per_block + 1] += Popcount64(this->words[w]);
+	}
+	for (uint64_t i = 1; i <= blocks; i++) {
+		uint64_t parent = i + (i & (~i + 1));
+		if (parent <= blocks) this->tree[parent] += this->tree[i];
+	}
+}
+
+
+/* ********************************* Layer ********************************* */
+
+MultilayerCounters::Layer::Layer(int counter_size)
+        : counter_size(counter_size), counter_max((1LL << (8 * counter_size)) - 1) {
+}
+
+void MultilayerCounters::Layer::AddToTree(std::vector<uint64_t> &tree, size_t block, long long amount) {
+	for (uint64_t i = block + 1; i < tree.size(); i += i & (~i + 1)) {
+		tree[i] += amount;
+	}
+}
+
+// Returns the sum of the Fenwick tree over the first blocks
+uint64_t MultilayerCounters::Layer::Prefix(const std::vector<uint64_t> &tree, size_t blocks) {
+	uint64_t sum = 0;
+	for (uint64_t i = blocks; i > 0; i -= i & (~i + 1)) {
+		sum += tree[i];
+	}
+	return sum;
+}
+
+// Rebuilds the Fenwick trees of the block counts in linear time, once
+// blocks are added or removed
+void MultilayerCounters::Layer::Rebuild() {
+	const uint64_t blocks = this->blocks.size();
+
+	this->count_tree.assign(blocks + 1, 0);
+	this->spilled_tree.assign(blocks + 1, 0);
+	for (uint64_t b = 0; b < blocks; b++) {
+		this->count_tree[b + 1] = this->blocks[b].count;
+		for (uint64_t word : this->blocks[b].spilled) this->spilled_tree[b + 1] += Popcount64(word);
+	}
+	for (uint64_t i = 1; i <= blocks; i++) {
+		uint64_t parent = i + (i & (~i + 1));
+		if (parent <= blocks) {
+			this->count_tree[parent] += this->count_tree[i];
+			this->spilled_tree[parent] += this->spilled_tree[i];
+		}
+	}
+}
+
+// Returns the position of the counter at the rank (below Counters()), by
+// descending the Fenwick tree of the block counts
+MultilayerCounters::Layer::Position MultilayerCounters::Layer::Find(uint64_t rank) const {
+	const uint64_t blocks = this->blocks.size();
+	uint64_t step = 1;
+	while (step * 2 <= blocks) step *= 2;
+
+	uint64_t block = 0;
+	for (; step > 0; step >>= 1) {
+		if (block + step <= blocks && this->count_tree[block + step] <= rank) {
+			block += step;
+			rank -= this->count_tree[block];
+		}
+	}
+
+	return {(size_t) block, (uint32_t) rank};
+}
+
+long long MultilayerCounters::Layer::Get(Position position) const {
+	const unsigned char *p = &this->blocks[position.block].counters[position.offset * this->counter_size];
+	long long value = 0;
+	for (int i = this->counter_size - 1; i >= 0; i--) {
+		value = (value << 8) | p[i];
+	}
+	return value;
+}
+
+void MultilayerCounters::Layer::Set(Position position, long long value) {
+	unsigned char *p = &this->blocks[position.block].counters[position.offset * this->counter_size];
+	for (int i = 0; i < this->counter_size; i++) {
+		p[i] = (unsigned char)(value >> (8 * i));
+	}
+}
+
+bool MultilayerCounters::Layer::Spilled(Position position) const {
+	return (this->blocks[position.block].spilled[position.offset >> 6] >> (position.offset & 63)) & 1;
+}
+
+void MultilayerCounters::Layer::SetSpilled(Position position, bool spilled) {
+	if (this->Spilled(position) == spilled) return;
+	this->blocks[position.block].spilled[position.offset >> 6] ^= 1ULL << (position.offset & 63);
+	AddToTree(this->spilled_tree, position.block, spilled ? 1 : -1);
+}
+
+// Returns the number of spilled counters before the position, which is the
+// rank of its counter in the layer above
+uint64_t MultilayerCounters::Layer::SpilledRank(Position position) const {
+	const Block &block = this->blocks[position.block];
+	uint64_t rank = Prefix(this->spilled_tree, position.block);
+
+	for (uint32_t w = 0; w < (position.offset >> 6); w++) {
+		rank += Popcount64(block.spilled[w]);
+	}
+	if (position.offset & 63) {
+		rank += Popcount64(block.spilled[position.offset >> 6] & ((1ULL << (position.offset & 63)) - 1));
+	}
+
+	return rank;
+}
+
+// Inserts a 0 counter, not spilled, at the rank (up to Counters()). A full
+// block is split in two halves.
+void MultilayerCounters::Layer::Insert(uint64_t rank) {
+	if (this->blocks.empty()) {
+		this->blocks.emplace_back();
+		this->Rebuild();
+	}
+
+	Position position;
+	if (rank == this->count) position = {this->blocks.size() - 1, this->blocks.back().count};
+	else position = this->Find(rank);
+
+	Block &block = this->blocks[position.block];
+	block.counters.insert(block.counters.begin() + position.offset * this->counter_size, this->counter_size, 0);
+
+	// Moves the spilled bits from the offset up by one
+	const uint32_t first = position.offset >> 6;
+	for (uint32_t w = BLOCK_COUNTERS / 64 - 1; w > first; w--) {
+		block.spilled[w] = (block.spilled[w] << 1) | (block.spilled[w - 1] >> 63);
+	}
+	const uint64_t low = (1ULL << (position.offset & 63)) - 1;
+	block.spilled[first] = (block.spilled[first] & low) | ((block.spilled[first] & ~low) << 1);
+
+	block.count++;
+	this->count++;
+	AddToTree(this->count_tree, position.block, 1);
+	if (block.count < BLOCK_COUNTERS) return;
+
+	Block upper;
+	const uint32_t half = BLOCK_COUNTERS / 2;
+	upper.count = block.count - half;
+	upper.counters.assign(block.counters.begin() + half * this->counter_size, block.counters.end());
+	for (uint32_t w = 0; w < half / 64; w++) {
+		upper.spilled[w] = block.spilled[w + half / 64];
+		block.spilled[w + half / 64] = 0;
+	}
+	block.count = half;
+	block.counters.resize(half * this->counter_size);
+
+	this->blocks.insert(this->blocks.begin() + position.block + 1, std::move(upper));
+	this->Rebuild();
+}
+
+// Removes the counter at the position. An empty block is removed.
+void MultilayerCounters::Layer::Erase(Position position) {
+	this->SetSpilled(position, false);
+
+	Block &block = this->blocks[position.block];
+	auto first_counter = block.counters.begin() + position.offset * this->counter_size;
+	block.counters.erase(first_counter, first_counter + this->counter_size);
+
+	// Moves the spilled bits after the offset down by one
+	const uint32_t first = position.offset >> 6;
+	const uint64_t low = (1ULL << (position.offset & 63)) - 1;
+	block.spilled[first] = (block.spilled[first] & low) | ((block.spilled[first] >> 1) & ~low);
+	for (uint32_t w = first; w + 1 < BLOCK_COUNTERS / 64; w++) {
+		block.spilled[w] |= block.spilled[w + 1] << 63;
+		block.spilled[w + 1] >>= 1;
+	}
+
+	block.count--;
+	this->count--;
+	AddToTree(this->count_tree, position.block, -1);
+	if (block.count > 0) return;
+
+	this->blocks.erase(this->blocks.begin() + position.block);
+	this->Rebuild();
+}
+
+size_t MultilayerCounters::Layer::Bytes() const {
+	return this->count * this->counter_size + this->blocks.size() * sizeof(Block)
+	        + (this->count_tree.size() + this->spilled_tree.size()) * sizeof(uint64_t);
+}
+
+
+/* *************************** MultilayerCounters ************************** */
+
+MultilayerCounters::MultilayerCounters(uint64_t base_cells) : base_cells(base_cells) {
+}
+
+// Adds a layer on top of the existing ones. The bitmap of the base cells is
+// allocated with layer 1.
+void MultilayerCounters::AddLayer() {
+	if ((int)this->layers.size() == MAX_LAYERS) {
+		throw std::overflow_error("Too many counter layers");
+	}
+
+	const int layer = (int)this->layers.size();
+	if (layer == 0) this->spilled.Resize(this->base_cells);
+	this->layers.emplace_back(1 << std::min(layer, 2));
+}
+
+long long MultilayerCounters::Get(uint64_t index) const {
+	if (this->layers.empty() || !this->spilled.Test(index)) return 0;
+
+	uint64_t rank = this->spilled.Rank(index);
+	long long total = 0;
+
+	for (const Layer &layer : this->layers) {
+		Layer::Position position = layer.Find(rank);
+		total += layer.Get(position);
+		if (!layer.Spilled(position)) break;
+		rank = layer.SpilledRank(position);
+	}
+
+	return total;
+}
+
+void MultilayerCounters::Add(uint64_t index, long long amount) {
+	this->total += amount;
+
+	if (this->layers.empty()) this->AddLayer();
+	uint64_t rank = this->spilled.Rank(index);
+	if (!this->spilled.Test(index)) {
+		this->spilled.Set(index);
+		this->layers[0].Insert(rank);
+	}
+
+	for (size_t l = 0;; l++) {
+		Layer::Position position = this->layers[l].Find(rank);
+		long long value = this->layers[l].Get(position) + amount;
+		if (value <= this->layers[l].counter_max) {
+			this->layers[l].Set(position, value);
+			return;
+		}
+
+		// Saturates this counter and spills the rest into the layer above
+		this->layers[l].Set(position, this->layers[l].counter_max);
+		amount = value - this->layers[l].counter_max;
+		if (l + 1 == this->layers.size()) this->AddLayer();
+
+		rank = this->layers[l].SpilledRank(position);
+		if (!this->layers[l].Spilled(position)) {
+			this->layers[l].SetSpilled(position, true);
+			this->layers[l + 1].Insert(rank);
+		}
+	}
+}
+
+long long MultilayerCounters::Subtract(uint64_t index, long long amount) {
+	if (this->layers.empty() || !this->spilled.Test(index)) return amount;
+
+	Layer::Position positions[MAX_LAYERS];
+	int chain = 0;
+
+	// Finds the counters of the cell, from layer 1 up
+	uint64_t rank = this->spilled.Rank(index);
+	for (const Layer &layer : this->layers) {
+		positions[chain] = layer.Find(rank);
+		if (!layer.Spilled(positions[chain++])) break;
+		rank = layer.SpilledRank(positions[chain - 1]);
+	}
+
+	// Only the top counter of the cell may be below its maximum value, so
+	// counters are emptied from the top down
+	for (int l = chain - 1; l >= 0 && amount > 0; l--) {
+		Layer &layer = this->layers[l];
+		long long value = layer.Get(positions[l]);
+		long long taken = std::min(value, amount);
+		amount -= taken;
+		this->total -= taken;
+
+		if (value > taken) {
+			layer.Set(positions[l], value - taken);
+			continue;
+		}
+
+		// Removes the empty counter, whose counter above was already
+		// removed, and clears its bit in the layer below
+		layer.Erase(positions[l]);
+		if (l > 0) this->layers[l - 1].SetSpilled(positions[l - 1], false);
+		else this->spilled.Clear(index);
+	}
+
+	// Drops the empty top layers
+	while (!this->layers.empty() && this->layers.back().Counters() == 0) {
+		this->layers.pop_back();
+	}
+	if (this->layers.empty()) this->spilled = RankBitmap();
+
+	return amount;
+}
+
+void MultilayerCounters::Clear() {
+	this->layers.clear();
+	this->spilled = RankBitmap();
+	this->total = 0;
+}
+
+uint64_t MultilayerCounters::LayerCounters(int layer) const {
+	return this->layers[layer - 1].Counters();
+}
+
+// The bitmap of the base cells is counted in layer 1, and the spilled bits
+// of the counters of each layer in that layer
+size_t MultilayerCounters::LayerBytes(int layer) const {
+	const Layer &l = this->layers[layer - 1];
+	return l.Bytes() + (layer == 1 ? this->spilled.Bytes() : 0);
+}
+
+} //namespace cbf
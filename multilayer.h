@@ -0,0 +1,166 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef MULTILAYER_H
+#define MULTILAYER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cbf {
+
+// Upper layers of a multilayer CBF (see Ficara et al., "Multilayer Compressed
+// Counting Bloom Filters"). The base layer is the filter array of the CBF:
+// when the counter of a base cell would exceed its maximum value, the cell
+// spills into layer 1, which holds one counter for each spilled base cell.
+// In the same way, the counters of layer 1 spill into layer 2, and so on.
+// A bitmap marks which base cells spilled, and each counter of a layer
+// carries a bit marking whether it spilled into the layer above. Counters
+// are kept in the order of the cells they belong to: the counter of a cell
+// is found at the rank (number of set bits before it) of its bit in the
+// layer below. The value of a cell is the sum of its counters over all the
+// layers, saturated counters included.
+// Counters of layer 1 take 1 byte, of layer 2 2 bytes and of upper layers
+// 4 bytes, so that few layers are ever needed.
+class MultilayerCounters {
+
+private:
+	// Bitmap with a rank directory: the number of set bits in each block
+	// of RANK_BITS bits is kept in a Fenwick tree, so that both ranks and
+	// updates take a logarithmic time.
+	class RankBitmap {
+	public:
+		static const int RANK_BITS = 512;
+
+		uint64_t Size() const { return this->bits; }
+		bool Test(uint64_t position) const;
+		void Set(uint64_t position);
+		void Clear(uint64_t position);
+		void Resize(uint64_t bits);
+		uint64_t Rank(uint64_t position) const;
+		size_t Bytes() const;
+
+	private:
+		uint64_t bits = 0;
+		std::vector<uint64_t> words;
+		std::vector<uint64_t> tree;
+
+		void AddToTree(uint64_t block, long long amount);
+		void Rebuild();
+	};
+
+	// Counters of a layer, with their spilled bits. Counters are stored in
+	// blocks of at most BLOCK_COUNTERS counters, and the number of counters
+	// and of spilled counters of each block are kept in Fenwick trees, so
+	// that a counter is found in a logarithmic time and inserting or
+	// erasing one only moves the counters of its block.
+	class Layer {
+	public:
+		static const int BLOCK_COUNTERS = 256;
+
+		// A counter, located by its block and its offset in the block
+		struct Position {
+			size_t block;
+			uint32_t offset;
+		};
+
+		int counter_size;
+		long long counter_max;
+
+		explicit Layer(int counter_size);
+
+		uint64_t Counters() const { return this->count; }
+		Position Find(uint64_t rank) const;
+		long long Get(Position position) const;
+		void Set(Position position, long long value);
+		bool Spilled(Position position) const;
+		void SetSpilled(Position position, bool spilled);
+		uint64_t SpilledRank(Position position) const;
+		void Insert(uint64_t rank);
+		void Erase(Position position);
+		size_t Bytes() const;
+
+	private:
+		struct Block {
+			uint32_t count = 0;
+			uint64_t spilled[BLOCK_COUNTERS / 64] = {};
+			std::vector<unsigned char> counters;
+		};
+
+		std::vector<Block> blocks;
+		std::vector<uint64_t> count_tree;
+		std::vector<uint64_t> spilled_tree;
+		uint64_t count = 0;
+
+		static void AddToTree(std::vector<uint64_t> &tree, size_t block, long long amount);
+		static uint64_t Prefix(const std::vector<uint64_t> &tree, size_t blocks);
+		void Rebuild();
+	};
+
+	RankBitmap spilled;
+	std::vector<Layer> layers;
+	uint64_t base_cells;
+	long long total = 0;
+
+	void AddLayer();
+
+public:
+	// The maximum number of upper layers
+	const static int MAX_LAYERS = 8;
+
+	explicit MultilayerCounters(uint64_t base_cells = 0);
+
+	// Returns the amount stored in the upper layers for the base cell
+	// (0 if the cell never spilled)
+	long long Get(uint64_t index) const;
+	// Adds amount (> 0) to the upper layers of the base cell, which must be
+	// saturated
+	void Add(uint64_t index, long long amount);
+	// Subtracts up to amount (> 0) from the upper layers of the base cell,
+	// starting from the top layer, and returns the part of amount that
+	// exceeds what the upper layers held
+	long long Subtract(uint64_t index, long long amount);
+	// Removes all the upper layers
+	void Clear();
+
+	// Returns the number of upper layers
+	int Layers() const { return (int)this->layers.size(); }
+	// Returns the number of counters of the upper layer (1 to Layers())
+	uint64_t LayerCounters(int layer) const;
+	// Returns the memory in bytes used by the upper layer (1 to Layers())
+	size_t LayerBytes(int layer) const;
+	// Returns the number of base cells that spilled into the upper layers
+	uint64_t SpilledCells() const { return this->layers.empty() ? 0 : this->layers[0].Counters(); }
+	// Returns the overall amount stored in the upper layers
+	long long Total() const { return this->total; }
+};
+
+} //namespace cbf
+
+#endif /* MULTILAYER_H */
@@ -0,0 +1,116 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "overflow.h"
+
+#include <algorithm>
+
+namespace cbf {
+
+// Returns the home slot of a cell index (Fibonacci hashing)
+size_t OverflowTable::Slot(uint64_t index) const {
+	return (size_t)((index * 0x9E3779B97F4A7C15ULL) >> 32) & (this->slots.size() - 1);
+}
+
+// Returns the slot holding the cell index, or the empty slot where it
+// should be inserted. The table is never full, so the search ends.
+size_t OverflowTable::Find(uint64_t index) const {
+	const size_t mask = this->slots.size() - 1;
+	size_t slot = this->Slot(index);
+	while (this->slots[slot].index != EMPTY && this->slots[slot].index != index) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Empties a slot, moving back the following entries of the same probe
+// sequence so that no tombstone is needed
+void OverflowTable::Erase(size_t slot) {
+	const size_t mask = this->slots.size() - 1;
+	size_t next = (slot + 1) & mask;
+	while (this->slots[next].index != EMPTY) {
+		size_t home = this->Slot(this->slots[next].index);
+		// Moves the entry back if its home slot is not in (slot, next]
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			this->slots[slot] = this->slots[next];
+			slot = next;
+		}
+		next = (next + 1) & mask;
+	}
+	this->slots[slot].index = EMPTY;
+	this->entries--;
+}
+
+// Doubles the number of slots, keeping the load factor below 1/2
+void OverflowTable::Grow() {
+	std::vector<Entry> old;
+	old.swap(this->slots);
+	this->slots.assign(std::max(INITIAL_SLOTS, old.size() * 2), Entry{EMPTY, 0});
+	for (const auto &entry : old) {
+		if (entry.index != EMPTY) this->slots[this->Find(entry.index)] = entry;
+	}
+}
+
+void OverflowTable::Add(uint64_t index, long long amount) {
+	if (amount == 0) return;
+	if (2 * (this->entries + 1) > this->slots.size()) this->Grow();
+
+	size_t slot = this->Find(index);
+	if (this->slots[slot].index == EMPTY) {
+		this->slots[slot].index = index;
+		this->slots[slot].amount = 0;
+		this->entries++;
+	}
+
+	this->slots[slot].amount += amount;
+	this->total += amount;
+	if (this->slots[slot].amount == 0) this->Erase(slot);
+}
+
+long long OverflowTable::Get(uint64_t index) const {
+	if (this->entries == 0) return 0;
+
+	size_t slot = this->Find(index);
+	return this->slots[slot].index == EMPTY ? 0 : this->slots[slot].amount;
+}
+
+void OverflowTable::Clear() {
+	this->slots.clear();
+	this->entries = 0;
+	this->total = 0;
+}
+
+std::vector<std::pair<uint64_t, long long> > OverflowTable::Sorted() const {
+	std::vector<std::pair<uint64_t, long long> > sorted;
+	sorted.reserve(this->entries);
+	for (const auto &entry : this->slots) {
+		if (entry.index != EMPTY) sorted.emplace_back(entry.index, entry.amount);
+	}
+	std::sort(sorted.begin(), sorted.end());
+	return sorted;
+}
+
+} //namespace cbf
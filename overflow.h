@@ -0,0 +1,88 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef OVERFLOW_H
+#define OVERFLOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace cbf {
+
+// Sparse store of the overflows of the CBF cells, i.e. the amount by which
+// the counter of each saturated cell exceeded its maximum value.
+// Only overflown cells take memory: the store is an open addressing hash
+// table (linear probing, backward shift deletion) keyed by cell index.
+// The overall number of overflows and of overflown cells are kept up to date,
+// so that they can be read in constant time.
+class OverflowTable {
+
+private:
+	struct Entry {
+		uint64_t index;
+		long long amount;
+	};
+
+	// Marks the empty slots of the table
+	static constexpr uint64_t EMPTY = ~(uint64_t)0;
+	// Initial number of slots (a power of 2)
+	static constexpr size_t INITIAL_SLOTS = 16;
+
+	std::vector<Entry> slots;
+	size_t entries;
+	long long total;
+
+	size_t Slot(uint64_t index) const;
+	size_t Find(uint64_t index) const;
+	void Erase(size_t slot);
+	void Grow();
+
+public:
+	OverflowTable() : entries(0), total(0) {}
+
+	// Adds amount (which may be negative) to the overflows of the cell.
+	// Cells whose overflows drop to 0 are removed from the store.
+	void Add(uint64_t index, long long amount);
+	// Returns the overflows of the cell (0 if the cell is not overflown)
+	long long Get(uint64_t index) const;
+	// Removes all the overflows
+	void Clear();
+
+	// Returns the overall number of overflows
+	long long Total() const { return this->total; }
+	// Returns the number of overflown cells
+	size_t Cells() const { return this->entries; }
+	// Returns the (cell index, overflows) pairs, sorted by cell index
+	std::vector<std::pair<uint64_t, long long> > Sorted() const;
+};
+
+} //namespace cbf
+
+#endif /* OVERFLOW_H */
@@ -0,0 +1,164 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "planner.h"
+
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+namespace cbf {
+
+
+// The memory taken by an overflown cell: a 16 bytes entry of the overflow
+// table (see OverflowTable), which is kept between 1/4 and 1/2 full
+static const double OVERFLOW_BYTES = 64;
+
+// The widest hash number tried: the optimal one for fpp targets down to 2^-64
+static const int MAX_PLANNED_HASH_NUMBER = 64;
+
+// Returns the a-priori fpp of a filter (see CBF::GetFilterAPrioriFpp)
+static double PlanFpp(uint64_t cells, int hash_number, long long unique_members) {
+	double p = 1 - pow(1 - 1 / (double) cells, (double) hash_number * unique_members);
+	return pow(p, hash_number);
+}
+
+// Returns the least number of cells for which a filter with the given hash
+// number meets the fpp target: the inverse of PlanFpp
+static uint64_t PlanCells(int hash_number, long long unique_members, double max_fpp) {
+	double fill = log1p(-pow(max_fpp, 1.0 / hash_number));
+	double cells = ceil(-1 / expm1(fill / ((double) hash_number * unique_members)));
+	if (!(cells < (double) (1ULL << CBF::MAX_BIT_MAPPING))) return 0;
+	uint64_t planned = std::max((uint64_t) cells, (uint64_t) 2);
+	// Rounding may leave the fpp slightly above the target
+	while (PlanFpp(planned, hash_number, unique_members) > max_fpp) planned++;
+	return planned;
+}
+
+// Fills the memory and the overflow probability of a plan whose cells, hash
+// number and counters width are set. Cells overflow in two ways:
+// - the cells of the heavy elements, whose multiplicity alone exceeds the
+//   counters. There are none if max_multiplicity fits the counters, and
+//   otherwise at most (total_multiplicity - unique_members) / counter_max of
+//   them, as each takes more than counter_max of the total multiplicity and
+//   each other element at least 1. Each one overflows its HASH_number cells.
+// - the cells where the other elements pile up, bounded by
+//   CBF::CellOverflowBound. The bound counts unit increments: elements are
+//   taken as increments of their mean multiplicity, so that a cell overflows
+//   once counter_max / mean of them are mapped to it.
+static void PlanMemory(CBFPlan &plan, long long unique_members, long long total_multiplicity,
+        int max_multiplicity) {
+	const int counter_max = plan.cell_bits == 32 ? INT_MAX : (1 << plan.cell_bits) - 1;
+
+	double heavy = 0;
+	if (max_multiplicity > counter_max) {
+		heavy = std::max(1.0, std::min((double) unique_members,
+		        floor((double) (total_multiplicity - unique_members) / counter_max)));
+	}
+
+	const double mean = (double) total_multiplicity / unique_members;
+	const int increments = (int) std::max(1.0, floor(counter_max / mean));
+	long double piled = CBF::CellOverflowBound(plan.cells, plan.HASH_number, unique_members, increments);
+	if (!(piled < 1)) piled = 1;
+
+	const double overflown = std::min((double) plan.cells, heavy * plan.HASH_number + (double) (piled * plan.cells));
+	plan.overflow = overflown / plan.cells;
+	plan.bytes = (plan.cells * plan.cell_bits + 7) / 8 + CBF::FILTER_PADDING
+	        + (uint64_t) ceil(overflown * OVERFLOW_BYTES);
+}
+
+CBFPlan PlanCBF(long long unique_members, long long total_multiplicity, int max_multiplicity, double max_fpp,
+        uint64_t max_bytes) {
+	if (unique_members <= 0) throw std::invalid_argument("Invalid number of elements.");
+	if (total_multiplicity < unique_members) throw std::invalid_argument("Invalid total multiplicity.");
+	if (max_multiplicity <= 0 || max_multiplicity > total_multiplicity ||
+	    (double) max_multiplicity * unique_members < (double) total_multiplicity) {
+		throw std::invalid_argument("Invalid maximum multiplicity.");
+	}
+	if (!(max_fpp > 0 && max_fpp < 1)) throw std::invalid_argument("Invalid fpp target.");
+
+	static const int WIDTHS[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 32};
+
+	// The configuration taking the least memory for the fpp target
+	CBFPlan best;
+	for (int hash_number = 1; hash_number <= MAX_PLANNED_HASH_NUMBER; hash_number++) {
+		uint64_t cells = PlanCells(hash_number, unique_members, max_fpp);
+		if (cells == 0) continue;
+
+		for (int cell_bits : WIDTHS) {
+			CBFPlan plan;
+			plan.cells = cells;
+			plan.HASH_number = hash_number;
+			plan.cell_bits = cell_bits;
+			PlanMemory(plan, unique_members, total_multiplicity, max_multiplicity);
+			if (best.cells == 0 || plan.bytes < best.bytes) best = plan;
+		}
+	}
+	if (best.cells == 0) throw std::invalid_argument("The fpp target needs too many cells.");
+	best.fpp = PlanFpp(best.cells, best.HASH_number, unique_members);
+
+	// Otherwise, the configuration with the lowest fpp within the budget:
+	// for each hash number and counters width, the most cells that fit
+	if (max_bytes > 0 && best.bytes > max_bytes) {
+		best = CBFPlan();
+		for (int hash_number = 1; hash_number <= MAX_PLANNED_HASH_NUMBER; hash_number++) {
+			for (int cell_bits : WIDTHS) {
+				CBFPlan plan;
+				plan.HASH_number = hash_number;
+				plan.cell_bits = cell_bits;
+				plan.cells = std::min((max_bytes - std::min(max_bytes, (uint64_t) CBF::FILTER_PADDING)) * 8 / cell_bits,
+				        (uint64_t) 1 << CBF::MAX_BIT_MAPPING);
+				// The overflows grow as the cells shrink: gives up on widths
+				// whose overflows do not fit
+				for (int step = 0; step < 64 && plan.cells >= 2; step++) {
+					PlanMemory(plan, unique_members, total_multiplicity, max_multiplicity);
+					if (plan.bytes <= max_bytes) break;
+					plan.cells -= std::min(plan.cells, std::max((plan.bytes - max_bytes) * 8 / cell_bits, (uint64_t) 1));
+				}
+				if (plan.cells < 2 || plan.bytes > max_bytes) continue;
+
+				plan.fpp = PlanFpp(plan.cells, hash_number, unique_members);
+				if (best.cells == 0 || plan.fpp < best.fpp || (plan.fpp == best.fpp && plan.bytes < best.bytes)) {
+					best = plan;
+				}
+			}
+		}
+		if (best.cells == 0) throw std::invalid_argument("The memory budget is too small.");
+	}
+
+	best.MULTIPLICITY_max = max_multiplicity;
+	best.config.cells = best.cells;
+	if (best.cell_bits == 32) best.config.forced_cell_size = 4;
+	else best.config.cell_bits = best.cell_bits;
+	return best;
+}
+
+std::unique_ptr<CBF> CBFPlan::Build(int HASH_family, const std::string& salt_path) const {
+	return std::unique_ptr<CBF>(new CBF(0, HASH_family, this->HASH_number, this->MULTIPLICITY_max, salt_path,
+	        this->config));
+}
+
+} //namespace cbf
@@ -0,0 +1,89 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "cbf.h"
+
+#include <memory>
+#include <string>
+
+namespace cbf {
+
+// Configuration of a CBF chosen by PlanCBF for the expected elements, and
+// factory of the filter
+struct DLL_PUBLIC CBFPlan {
+	// The number of hash runs
+	int HASH_number = 0;
+	// The maximum multiplicity passed to the CBF constructor
+	int MULTIPLICITY_max = 0;
+	// The optional parameters of the filter: the number of cells and the
+	// counters width are set (CBFConfig::cells, and CBFConfig::cell_bits or
+	// CBFConfig::forced_cell_size for 32 bits counters), the others can be
+	// changed before Build
+	CBFConfig config;
+	// The number of cells and the counters width in bits
+	uint64_t cells = 0;
+	int cell_bits = 0;
+	// The expected memory in bytes: the filter array and the overflows of
+	// the cells expected to overflow
+	uint64_t bytes = 0;
+	// The expected a-priori fpp (see CBF::GetFilterAPrioriFpp)
+	double fpp = 0;
+	// The expected overflow probability of a cell (see PlanCBF)
+	long double overflow = 0;
+
+	// Builds the filter, with the hash salts of salt_path (created if the
+	// file does not exist)
+	std::unique_ptr<CBF> Build(int HASH_family, const std::string& salt_path) const;
+};
+
+// Returns the configuration of the CBF that takes the least memory for the
+// expected elements and fpp target, over the numbers of cells (not only
+// powers of 2), the numbers of hash runs and the counters widths (packed
+// counters of 1 to 16 bits, and 32 bits counters). The memory counts the
+// filter array and the expected overflown cells: the cells of the elements
+// whose multiplicity exceeds the counters, and those where elements pile up
+// (bounded by CBF::CellOverflowBound), so that narrow counters are only
+// chosen when few of them overflow.
+// If the configuration takes more than max_bytes bytes, the configuration
+// with the lowest fpp that takes at most max_bytes bytes is returned instead
+// (and its fpp is above the target).
+// Arguments:
+// unique_members     the expected number of unique elements
+// total_multiplicity the expected sum of the multiplicities of the elements
+// max_multiplicity   the expected maximum multiplicity of an element
+// max_fpp            the fpp target, in (0, 1)
+// max_bytes          the memory budget in bytes (0 for none)
+DLL_PUBLIC CBFPlan PlanCBF(long long unique_members, long long total_multiplicity, int max_multiplicity,
+        double max_fpp, uint64_t max_bytes = 0);
+
+} //namespace cbf
+
+#endif /* PLANNER_H */
@@ -0,0 +1,158 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scalable.h"
+
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+namespace cbf {
+
+
+ScalableCBF::ScalableCBF(int bit_mapping, int HASH_family, int MULTIPLICITY_max, const std::string& salt_path,
+        double max_fpp, const CBFConfig& config, int growth, double tightening) {
+	if (!(max_fpp > 0 && max_fpp < 1)) throw std::invalid_argument("Invalid fpp target.");
+	if (growth < 2) throw std::invalid_argument("Invalid growth.");
+	if (!(tightening > 0 && tightening < 1)) throw std::invalid_argument("Invalid tightening.");
+	if (salt_path.length() == 0) throw std::invalid_argument("Invalid hash salt path.");
+
+	this->HASH_family = HASH_family;
+	this->MULTIPLICITY_max = MULTIPLICITY_max;
+	this->salt_path = salt_path;
+	this->config = config;
+	this->max_fpp = max_fpp;
+	this->growth = growth;
+	this->tightening = tightening;
+
+	// The first stage takes the cells of bit_mapping, so that the next ones
+	// only have to scale config.cells
+	if (this->config.cells == 0) {
+		if (bit_mapping <= 0 || bit_mapping > CBF::MAX_BIT_MAPPING) throw std::invalid_argument("Invalid bit mapping.");
+		this->config.cells = 1ULL << bit_mapping;
+	}
+
+	this->AddStage();
+}
+
+// Adds a stage 'growth' times larger than the last one, with a target fpp
+// 'tightening' times lower, and the number of hash runs that is optimal for
+// it when half of its cells are set
+void ScalableCBF::AddStage() {
+	const int stage = (int) this->stages.size();
+	if (stage == MAX_STAGES) throw std::length_error("Too many stages.");
+
+	double target = this->max_fpp * (1 - this->tightening) * std::pow(this->tightening, stage);
+	int hash_number = (int) std::ceil(std::log2(1 / target));
+	if (hash_number > CBF::MAX_HASH_NUMBER) hash_number = CBF::MAX_HASH_NUMBER;
+
+	// Cells are scaled from those of the first stage, so that the rounding
+	// of blocked stages to whole blocks does not pile up
+	CBFConfig stage_config = this->config;
+	for (int s = 0; s < stage; s++) {
+		if (stage_config.cells > (1ULL << CBF::MAX_BIT_MAPPING) / this->growth) {
+			throw std::length_error("The filter cannot grow further.");
+		}
+		stage_config.cells *= this->growth;
+	}
+
+	std::unique_ptr<CBF> filter(new CBF(0, this->HASH_family, hash_number, this->MULTIPLICITY_max,
+	        this->salt_path + "." + std::to_string(stage), stage_config));
+
+	// The capacity of the stage is the least number of unique elements whose
+	// a-priori fpp passes the target: the fpp grows with the elements, so it
+	// is bracketed by doubling and then found by bisection
+	long long low = 0, high = 1;
+	while (!(filter->GetAPrioriFpp(high) > target) && high < LLONG_MAX / 2) {
+		low = high;
+		high *= 2;
+	}
+	while (high - low > 1) {
+		long long middle = low + (high - low) / 2;
+		if (filter->GetAPrioriFpp(middle) > target) high = middle;
+		else low = middle;
+	}
+
+	this->stages.push_back(std::move(filter));
+	this->targets.push_back(target);
+	this->capacities.push_back(high);
+}
+
+void ScalableCBF::Insert(std::string_view element, int multiplicity) {
+	CBF &stage = *this->stages.back();
+
+	stage.Insert(element, multiplicity);
+
+	if (stage.GetUniqueMembers() >= this->capacities.back()) this->AddStage();
+}
+
+int ScalableCBF::Check(std::string_view element, bool with_overflows) const {
+	long long counter = 0;
+
+	for (const auto &stage : this->stages) {
+		counter += stage->Check(element, with_overflows);
+	}
+
+	return (int) std::min(counter, (long long) INT_MAX);
+}
+
+const CBF &ScalableCBF::GetStage(int stage) const {
+	if (stage < 0 || stage >= (int) this->stages.size()) throw std::out_of_range("Invalid stage.");
+
+	return *this->stages[stage];
+}
+
+double ScalableCBF::GetStageTarget(int stage) const {
+	if (stage < 0 || stage >= (int) this->stages.size()) throw std::out_of_range("Invalid stage.");
+
+	return this->targets[stage];
+}
+
+long long ScalableCBF::GetMembers() const {
+	long long members = 0;
+	for (const auto &stage : this->stages) members += stage->GetMembers();
+	return members;
+}
+
+long long ScalableCBF::GetUniqueMembers() const {
+	long long unique_members = 0;
+	for (const auto &stage : this->stages) unique_members += stage->GetUniqueMembers();
+	return unique_members;
+}
+
+double ScalableCBF::GetFilterAPrioriFpp() const {
+	double p = 1;
+	for (const auto &stage : this->stages) p *= 1 - stage->GetFilterAPrioriFpp();
+	return 1 - p;
+}
+
+uint64_t ScalableCBF::GetMemory() const {
+	uint64_t memory = 0;
+	for (const auto &stage : this->stages) memory += (uint64_t) stage->GetLayerMemory(0);
+	return memory;
+}
+
+} //namespace cbf
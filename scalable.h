@@ -0,0 +1,117 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef SCALABLE_H
+#define SCALABLE_H
+
+#include "cbf.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cbf {
+
+// Counting Bloom filter that grows with the number of elements mapped to it,
+// so that it needs not be sized in advance (see Almeida et al., "Scalable
+// Bloom Filters"). The filter is made of stages, CBFs that are each larger
+// than the previous one by 'growth' times, with a tighter fpp target: stage
+// i has the target max_fpp * (1 - tightening) * tightening^i and
+// ceil(log2(1 / target)) hash runs, so that the fpp of the whole filter stays
+// below max_fpp. Insert maps elements to the last stage, and a new stage is
+// added when its a-priori fpp (see CBF::GetFilterAPrioriFpp) passes its
+// target: the number of unique elements at which it does is computed once,
+// when the stage is added. Check sums the counters of an element over the
+// stages.
+// Stage i takes the hash salts of salt_path + "." + i, created if the file
+// does not exist. A file holding fewer salts than the hash runs of its stage
+// (created for a higher max_fpp or tightening) is rejected: the constructor,
+// or the Insert adding the stage, throws std::runtime_error.
+class DLL_PUBLIC ScalableCBF {
+
+private:
+	std::vector<std::unique_ptr<CBF> > stages;
+	std::vector<double> targets;
+	std::vector<long long> capacities;
+	int HASH_family;
+	int MULTIPLICITY_max;
+	std::string salt_path;
+	CBFConfig config;
+	double max_fpp;
+	int growth;
+	double tightening;
+
+	void AddStage();
+
+public:
+	// The maximum number of stages
+	const static int MAX_STAGES = 64;
+
+	// ScalableCBF class constructor
+	// Arguments:
+	// bit_mapping      the size of the first stage: 2^bit_mapping cells (or
+	//                  config.cells, if set)
+	// HASH_family      see the CBF constructor
+	// MULTIPLICITY_max see the CBF constructor
+	// salt_path        the prefix of the paths of the hash salts of the stages
+	// max_fpp          the fpp target of the whole filter, in (0, 1)
+	// config           the optional parameters of the stages (see CBFConfig)
+	// growth           the ratio between the cells of consecutive stages (>= 2)
+	// tightening       the ratio between the fpp targets of consecutive
+	//                  stages, in (0, 1)
+	ScalableCBF(int bit_mapping, int HASH_family, int MULTIPLICITY_max, const std::string& salt_path,
+	        double max_fpp, const CBFConfig& config = CBFConfig(), int growth = 2, double tightening = 0.9);
+
+	// Maps an element to the last stage, and adds a stage if this one
+	// passed its fpp target
+	void Insert(std::string_view element, int multiplicity);
+	// Returns the counter of an element: the sum of its counters (see
+	// CBF::Check) in all the stages
+	int Check(std::string_view element, bool with_overflows = false) const;
+
+	// Returns the number of stages
+	int GetStages() const { return (int) this->stages.size(); }
+	// Returns a stage, 0 being the first one
+	const CBF &GetStage(int stage) const;
+	// Returns the fpp target of a stage
+	double GetStageTarget(int stage) const;
+	// Returns the number of elements (multiplicities included) and of
+	// unique elements mapped to the filter
+	long long GetMembers() const;
+	long long GetUniqueMembers() const;
+	// Returns the a-priori fpp of the filter: the probability that an element
+	// is a false positive in at least one stage
+	double GetFilterAPrioriFpp() const;
+	// Returns the memory in bytes of the filter arrays of the stages
+	uint64_t GetMemory() const;
+};
+
+} //namespace cbf
+
+#endif /* SCALABLE_H */
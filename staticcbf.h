@@ -0,0 +1,229 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef STATICCBF_H
+#define STATICCBF_H
+
+#include "cbf.h"
+#include "cells.h"
+#include "fasthash.h"
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace cbf {
+
+// Hash policies of StaticCBF: each one computes the first 8 bytes of the
+// digest of a CBF of the same hash family, as a little endian 64-bit word.
+struct Murmur3Hasher {
+	static const int FAMILY = 6;
+
+	static inline uint64_t Digest(const char *d, size_t n, uint64_t seed) {
+		unsigned char md[16];
+		murmur3_128(d, n, seed, md);
+		return load_le64(md);
+	}
+};
+
+struct XXHash64Hasher {
+	static const int FAMILY = 7;
+
+	static inline uint64_t Digest(const char *d, size_t n, uint64_t seed) {
+		return xxh64(d, n, seed);
+	}
+};
+
+struct WyHasher {
+	static const int FAMILY = 8;
+
+	static inline uint64_t Digest(const char *d, size_t n, uint64_t seed) {
+		return wyhash(d, n, seed);
+	}
+};
+
+// Front end of a CBF whose counter type, hash function and hash number are
+// fixed at compile time. Insert and Check run the K hash runs in a fully
+// unrolled loop, with no branch on the hash family or the cell size, which
+// the CBF checks at run time for each cell.
+// The counters, salts, overflows and statistics are those of the CBF it wraps
+// (see GetFilter), so that filters saved by either one (see CBF::SaveToDisk)
+// are loaded by the other. The CBF must use native counters of
+// sizeof(Counter) bytes, the hash family of Hasher, K hash runs, the
+// INDEX_SALTED index mode and the LAYOUT_CLASSIC layout, and must not be
+// concurrent nor use conservative updates or adaptive counters: other
+// filters are rejected with std::invalid_argument.
+// Counter            uint8_t, uint16_t or uint32_t
+// Hasher             Murmur3Hasher, XXHash64Hasher or WyHasher
+// K                  the number of hash runs
+template<typename Counter, typename Hasher, int K>
+class StaticCBF {
+	static_assert(std::is_same<Counter, uint8_t>::value || std::is_same<Counter, uint16_t>::value ||
+	        std::is_same<Counter, uint32_t>::value, "Counters must be uint8_t, uint16_t or uint32_t");
+	static_assert(K > 0 && K <= CBF::MAX_HASH_NUMBER, "Invalid number of hash runs");
+
+private:
+	typedef NativeCells<Counter> Cells;
+
+	CBF filter;
+	uint64_t seeds[K];
+
+	// Returns a config with counters of type Counter and salted indices
+	static CBFConfig StaticConfig(CBFConfig config) {
+		config.forced_cell_size = sizeof(Counter);
+		config.cell_bits = 0;
+		config.index_mode = CBF::INDEX_SALTED;
+		return config;
+	}
+
+	// Checks that the wrapped CBF matches the template arguments, and reads
+	// the seeds of the hash runs from its salts
+	void Bind() {
+		if (this->filter.HASH_family != Hasher::FAMILY || this->filter.HASH_number != K ||
+		    this->filter.cell_size != (int) sizeof(Counter) || this->filter.INDEX_mode != CBF::INDEX_SALTED ||
+		    this->filter.LAYOUT_mode != CBF::LAYOUT_CLASSIC || this->filter.concurrent ||
+		    this->filter.conservative_update || this->filter.adaptive) {
+			throw std::invalid_argument("The filter does not match the static CBF.");
+		}
+
+		for (int k = 0; k < K; k++) {
+			this->seeds[k] = load_le64(this->filter.HASH_salt[k]);
+		}
+	}
+
+	// Computes the index of the k-th hash run, as CBF::ComputeIndices does in
+	// the INDEX_SALTED mode: the digest is read as two little endian 32-bit
+	// words, the first one being the most significant
+	inline uint64_t Index(std::string_view element, int k) const {
+		uint64_t h = Hasher::Digest(element.data(), element.size(), this->seeds[k]);
+		h = (h << 32) | (h >> 32);
+		return CBF::FastRange(h, this->filter.cells);
+	}
+
+	// Computes the K indices of the element, unrolled
+	template<size_t... I>
+	inline void ComputeIndices(std::string_view element, uint64_t *indices, std::index_sequence<I...>) const {
+		((indices[I] = this->Index(element, (int) I)), ...);
+	}
+
+	// Increments the counter of a cell, as CBF::IncrementCell does
+	inline void IncrementCell(uint64_t index, int multiplicity) {
+		int cell_value = Cells::AddSaturated(this->filter.filter, index, multiplicity);
+
+		long long new_cell_value = (long long) cell_value + multiplicity;
+		if (new_cell_value > Cells::MAX) this->filter.AddExcess(index, new_cell_value - Cells::MAX);
+
+		if (cell_value == 0 && multiplicity != 0) this->filter.CountNonZeroCell(index, 1);
+	}
+
+	template<size_t... I>
+	inline void IncrementCells(const uint64_t *indices, int multiplicity, std::index_sequence<I...>) {
+		(this->IncrementCell(indices[I], multiplicity), ...);
+	}
+
+	template<size_t... I>
+	inline int MinCounter(const uint64_t *indices, std::index_sequence<I...>) const {
+		int counter = Cells::MAX;
+		((counter = std::min(counter, Cells::Get(this->filter.filter, indices[I]))), ...);
+		return counter;
+	}
+
+public:
+	// StaticCBF class constructor of an empty filter (see the CBF
+	// constructor). The counters, hash family, hash number and index mode
+	// of config are those of the template arguments.
+	StaticCBF(int bit_mapping, const std::string& salt_path, const CBFConfig& config = CBFConfig())
+	        : filter(bit_mapping, Hasher::FAMILY, K, Cells::MAX, salt_path, StaticConfig(config))
+	{
+		this->Bind();
+	}
+
+	// StaticCBF class constructor loading a filter saved by CBF::SaveToDisk
+	// in the binary format (mode 2)
+	explicit StaticCBF(const std::string& path)
+	        : filter(path)
+	{
+		this->Bind();
+	}
+
+	// StaticCBF class constructor mapping a filter saved by CBF::SaveToDisk
+	// in the binary format (mode 2), read-only (see the CBF constructor)
+	StaticCBF(const std::string& path, int mapping)
+	        : filter(path, mapping)
+	{
+		this->Bind();
+	}
+
+	// Maps an element to the filter (see CBF::Insert)
+	void Insert(std::string_view element, int multiplicity) {
+		uint64_t indices[K];
+
+		if (this->filter.read_only) throw std::logic_error("The filter is read-only.");
+		if (multiplicity < 0) {
+			std::string error_message = "Multiplicity must be in [0, ";
+			error_message += std::to_string(CBF::MAX_MULTIPLICITY);
+			error_message += "]\n";
+			throw std::invalid_argument(error_message);
+		}
+
+		this->ComputeIndices(element, indices, std::make_index_sequence<K>());
+		this->IncrementCells(indices, multiplicity, std::make_index_sequence<K>());
+
+		this->filter.AddMembers(1, multiplicity);
+	}
+
+	// Returns the counter of an element (see CBF::Check). Saturated counters
+	// are resolved by the CBF, whose overflows (or upper layers) apply.
+	int Check(std::string_view element, bool with_overflows = false) const {
+		uint64_t indices[K];
+
+		this->ComputeIndices(element, indices, std::make_index_sequence<K>());
+		int counter = this->MinCounter(indices, std::make_index_sequence<K>());
+
+		if (counter == Cells::MAX && (with_overflows || this->filter.multilayer)) {
+			return this->filter.Check(element, with_overflows);
+		}
+		return counter;
+	}
+
+	// Writes the filter to disk (see CBF::SaveToDisk)
+	void SaveToDisk(const std::string& path, int mode) {
+		this->filter.SaveToDisk(path, mode);
+	}
+
+	// Returns the CBF holding the counters, for its statistics and the
+	// operations of the CBF that have no static counterpart
+	const CBF &GetFilter() const { return this->filter; }
+	CBF &GetFilter() { return this->filter; }
+};
+
+} //namespace cbf
+
+#endif /* STATICCBF_H */
@@ -45,10 +45,9 @@ int main() {
 	std::ifstream myfile;
 	std::string line, a, member, path;
 	std::ofstream rate_file;
-	int len, line_count, multiplicity, multiplicity_check, n, nver;
+	int line_count, multiplicity, multiplicity_check, n, nver;
 	int well_recognised, false_positives, total_miscounts, max_diff_miscounts, miscount_value;
     std::unordered_map<int, int> miscounts_histogram;
-	char* element;
 	cbf::CBF* myFilter = nullptr;
 
 	/* ****************************** SETTINGS ****************************** */
@@ -58,6 +57,7 @@ int main() {
 
 	int perform_verification = 0;
 	int print_mode = 0;
+	int insert_mode = 0;
 
 	//desired false positives probability (upper bound)
 	double max_fpp = 0.001;
@@ -79,14 +79,12 @@ int main() {
 	std::string hash_salt("CBFHashSalt" + buf + ".txt");
 
 
-	//the exponent that determines filter size (in cells)
-	int bit_mapping;
-	//the number of hash executions for each mapped element
-	int hn;
 	//hash function to be used
 	int hf = 4;
 	//maximum multiplicity
     int max_multiplicity = 0;
+	//sum of the multiplicities
+	long long total_multiplicity = 0;
 
 	/* **************************** END SETTINGS **************************** */
 
@@ -107,7 +105,8 @@ int main() {
 	//asks for hash type (optional)
 	while (true) {
 		std::cout << "Enter the type of hash function to use:" << std::endl;
-		std::cout << "1 (SHA1), 4 (MD4), 5(MD5) (press ENTER for default)..." << std::endl;
+		std::cout << "1 (SHA1), 4 (MD4), 5(MD5), 6 (Murmur3), 7 (xxHash64), 8 (wyhash)" << std::endl;
+		std::cout << "(press ENTER for default)..." << std::endl;
 		getline(std::cin, input);
 
 		if (input.empty()) break;
@@ -148,6 +147,24 @@ int main() {
 	}
 
 
+    //asks for insertion mode (optional)
+    while (true) {
+        std::cout << "Enter the insertion mode to use:" << std::endl;
+        std::cout << "0 (standard), 1 (conservative update)" << std::endl;
+        std::cout << "(press ENTER for default)..." << std::endl;
+        getline(std::cin, input);
+
+        if (input.empty()) break;
+        else {
+            std::istringstream istr(input);
+            istr >> insert_mode;
+            if (insert_mode != 1) insert_mode = 0;
+            break;
+        }
+
+        std::cout << "Invalid number, please try again" << std::endl;
+    }
+
     //asks for print mode (optional)
     while (true) {
         std::cout << "Enter the print mode to use:" << std::endl;
@@ -181,6 +198,7 @@ int main() {
 			++line_count;
 			a = line.substr(0, line.find(delimiter));
             max_multiplicity = std::max(max_multiplicity, std::stoi(a));
+            total_multiplicity += std::stoi(a);
 		}
 		n = line_count;
 		myfile.close();
@@ -190,16 +208,17 @@ int main() {
 		exit(0);
 	}
 
-	//determines the optimal bit_mapping and hash number
-	int cells = (int)ceil((double)((double)-n*log(max_fpp)) / pow(log(2), 2));
-	bit_mapping = (int)ceil(log2(cells));
-	hn = (int)ceil((double)(cells / n)*log(2));
-
-	//constructs the filter and fills it with elements contained in the
-	//input dataset
+	//determines the number of cells, hash number and cell size which take
+	//the least memory for the desired false positives probability
+	//and constructs the filter
 	try {
+		cbf::CBFPlan plan = cbf::PlanCBF(n, total_multiplicity, max_multiplicity, max_fpp);
+		plan.config.conservative_update = (insert_mode == 1);
+		printf("Planned filter: %llu cells of %d bits, %d hash runs, %llu bytes\n\n",
+		       (unsigned long long) plan.cells, plan.cell_bits, plan.HASH_number, (unsigned long long) plan.bytes);
+
 		//filter construction
-		myFilter = new cbf::CBF(bit_mapping, hf, hn, max_multiplicity, hash_salt);
+		myFilter = plan.Build(hf, hash_salt).release();
 	}
 	catch (const std::invalid_argument& ia)
 	{
@@ -207,6 +226,7 @@ int main() {
         return 1;
 	}
 
+	//fills the filter with elements contained in the input dataset
 	myfile.open(construction_dataset.c_str());
 	if (myfile.is_open()) {
 		//elements insertion
@@ -217,10 +237,7 @@ int main() {
 			a = line.substr(0, line.find(delimiter));
 			multiplicity = atoi(a.c_str());
 			member = line.substr(line.find(delimiter) + 1);
-			len = member.length();
-			element = new char[len];
-			memcpy(element, member.c_str(), len);
-			myFilter->Insert(element, len, multiplicity);
+			myFilter->Insert(member, multiplicity);
 		}
 		myfile.close();
 	}
@@ -254,10 +271,7 @@ int main() {
 			a = line.substr(0, line.find(delimiter));
 			multiplicity = std::stoi(a);
 			member = line.substr(line.find(delimiter) + 1);
-			len = member.length();
-			element = new char[len];
-			memcpy(element, member.c_str(), len);
-            multiplicity_check = myFilter->Check(element, len);
+            multiplicity_check = myFilter->Check(member, true);
 
 			if (multiplicity == multiplicity_check) well_recognised++;
 			else {
@@ -330,10 +344,7 @@ int main() {
 			{
 				//reads one line
 				getline(myfile, line);
-				len = line.length();
-				element = new char[len];
-				memcpy(element, line.c_str(), len);
-                miscount_value = myFilter->Check(element, len);
+                miscount_value = myFilter->Check(line, true);
 
 				if (miscount_value == 0) well_recognised++;
 				else
@@ -0,0 +1,301 @@
+/*
+Counting Bloom Filter C++ Library (libCBF-cpp)
+
+Copyright (C) 2020 Lorenzo Pellegrini
+University of Bologna
+
+Based on Spatial Bloom Filter C++ Library (https://github.com/spatialbloomfilter/libSBF-cpp)
+Copyright (C) 2017  Luca Calderoni, Dario Maio,
+University of Bologna
+Copyright (C) 2017  Paolo Palmieri,
+Cranfield University
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cbflib.h>
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+//This program runs the regression tests of the library.
+//Usage: testCBF <test name>
+//Each test builds its own filters, in the working directory, and prints the
+//failed checks. The exit status is 0 if all the checks passed.
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++; \
+		} \
+	} while (0)
+
+static std::vector<std::string> elements;
+static std::vector<std::string> others;
+static std::vector<int> multiplicities;
+
+//builds the elements, with multiplicities that overflow 1 byte counters
+//every few elements, and as many elements that are not mapped
+static void make_elements(int n) {
+	for (int i = 0; i < n; i++) {
+		elements.push_back("element-" + std::to_string(i));
+		others.push_back("other-" + std::to_string(i));
+		multiplicities.push_back(i % 17 == 0 ? 300 + i : 1 + i % 5);
+	}
+}
+
+//returns a config with the given counters: cell_bits packed bits, or
+//cell_size native bytes if cell_bits is 0
+static cbf::CBFConfig counters_config(int cell_size, int cell_bits) {
+	cbf::CBFConfig config;
+	config.cells = 50000;
+	if (cell_bits > 0) config.cell_bits = cell_bits;
+	else config.forced_cell_size = cell_size;
+	return config;
+}
+
+//checks that two filters give the same counters to the elements and to
+//the other strings, and have the same members
+static void check_same_counters(const cbf::CBF &a, const cbf::CBF &b) {
+	int mismatches = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (a.Check(elements[i], true) != b.Check(elements[i], true)) mismatches++;
+		if (a.Check(others[i], true) != b.Check(others[i], true)) mismatches++;
+	}
+	CHECK(mismatches == 0);
+	CHECK(a.GetMembers() == b.GetMembers());
+	CHECK(a.GetUniqueMembers() == b.GetUniqueMembers());
+	CHECK(a.GetOverallOverflows() == b.GetOverallOverflows());
+}
+
+//checks that no element is counted below its multiplicity
+static void check_no_false_negatives(const cbf::CBF &filter) {
+	int missed = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (filter.Check(elements[i], true) < multiplicities[i]) missed++;
+	}
+	CHECK(missed == 0);
+}
+
+//BulkInsert must give the same filter as inserting the elements one by one
+static void test_bulk_insert() {
+	std::vector<cbf::CBFConfig> configs;
+	configs.push_back(counters_config(0, 4));
+	configs.push_back(counters_config(1, 0));
+	configs.push_back(counters_config(2, 0));
+	configs.push_back(counters_config(4, 0));
+	cbf::CBFConfig multilayer = counters_config(1, 0);
+	multilayer.multilayer = true;
+	configs.push_back(multilayer);
+	cbf::CBFConfig blocked = counters_config(1, 0);
+	blocked.layout = cbf::CBF::LAYOUT_BLOCKED;
+	configs.push_back(blocked);
+	cbf::CBFConfig concurrent = counters_config(2, 0);
+	concurrent.concurrent = true;
+	configs.push_back(concurrent);
+
+	std::vector<std::string_view> views(elements.begin(), elements.end());
+	for (const cbf::CBFConfig &config : configs) {
+		cbf::CBF sequential(0, 5, 6, 100000, "test-cbf-bulk.txt", config);
+		cbf::CBF bulk(0, 5, 6, 100000, "test-cbf-bulk.txt", config);
+
+		for (size_t i = 0; i < elements.size(); i++) {
+			sequential.Insert(elements[i], multiplicities[i]);
+		}
+		bulk.BulkInsert(views.data(), multiplicities.data(), views.size(), 4);
+
+		check_same_counters(sequential, bulk);
+		check_no_false_negatives(bulk);
+	}
+
+	std::remove("test-cbf-bulk.txt");
+}
+
+//a filter saved in the binary format must be loaded, or mapped, with the
+//same counters, overflows and members
+static void test_save_load() {
+	std::vector<cbf::CBFConfig> configs;
+	configs.push_back(counters_config(0, 4));
+	configs.push_back(counters_config(1, 0));
+	cbf::CBFConfig multilayer = counters_config(1, 0);
+	multilayer.multilayer = true;
+	configs.push_back(multilayer);
+
+	for (const cbf::CBFConfig &config : configs) {
+		cbf::CBF filter(0, 6, 5, 100000, "test-cbf-save.txt", config);
+		for (size_t i = 0; i < elements.size(); i++) {
+			filter.Insert(elements[i], multiplicities[i]);
+		}
+		filter.SaveToDisk("test-cbf-save.cbf", 2);
+
+		cbf::CBF loaded("test-cbf-save.cbf");
+		check_same_counters(filter, loaded);
+
+		cbf::CBF mapped("test-cbf-save.cbf", cbf::CBF::MAPPING_POPULATE);
+		check_same_counters(filter, mapped);
+		bool rejected = false;
+		try {
+			mapped.Insert(std::string_view("element"), 1);
+		} catch (const std::logic_error &) {
+			rejected = true;
+		}
+		CHECK(rejected);
+	}
+
+	std::remove("test-cbf-save.cbf");
+	std::remove("test-cbf-save.txt");
+}
+
+//a Remove that would take a cell below 0 must throw and leave the filter
+//unchanged
+static void test_remove_underflow() {
+	cbf::CBFConfig config = counters_config(1, 0);
+	cbf::CBF filter(0, 5, 6, 100000, "test-cbf-remove.txt", config);
+	cbf::CBF reference(0, 5, 6, 100000, "test-cbf-remove.txt", config);
+	for (size_t i = 0; i < elements.size(); i++) {
+		filter.Insert(elements[i], multiplicities[i]);
+		reference.Insert(elements[i], multiplicities[i]);
+	}
+
+	bool thrown = false;
+	try {
+		filter.Remove(elements[1], multiplicities[1] + 1000);
+	} catch (const std::underflow_error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+	check_same_counters(filter, reference);
+
+	//removing the whole multiplicity takes the element out of the unique
+	//members, while a partial removal does not
+	filter.Remove(elements[0], multiplicities[0] - 1);
+	CHECK(filter.GetUniqueMembers() == reference.GetUniqueMembers());
+	filter.Remove(elements[0], 1);
+	CHECK(filter.GetUniqueMembers() == reference.GetUniqueMembers() - 1);
+
+	std::remove("test-cbf-remove.txt");
+}
+
+//the counters of a multilayer CBF must be exact: the same as those of a
+//flat CBF with tracked overflows, also after removals
+static void test_multilayer_exact() {
+	cbf::CBFConfig flat = counters_config(1, 0);
+	cbf::CBFConfig multilayer = flat;
+	multilayer.multilayer = true;
+	cbf::CBF reference(0, 5, 6, 100000, "test-cbf-multilayer.txt", flat);
+	cbf::CBF filter(0, 5, 6, 100000, "test-cbf-multilayer.txt", multilayer);
+
+	for (size_t i = 0; i < elements.size(); i++) {
+		reference.Insert(elements[i], multiplicities[i]);
+		filter.Insert(elements[i], multiplicities[i]);
+		//multiplicities reaching the 2 and 4 bytes layers
+		if (i % 101 == 0) {
+			reference.Insert(elements[i], 70000);
+			filter.Insert(elements[i], 70000);
+		}
+	}
+	CHECK(filter.GetLayers() >= 2);
+	int mismatches = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (filter.Check(elements[i]) != reference.Check(elements[i], true)) mismatches++;
+	}
+	CHECK(mismatches == 0);
+
+	for (size_t i = 0; i < elements.size(); i += 3) {
+		reference.Remove(elements[i], multiplicities[i]);
+		filter.Remove(elements[i], multiplicities[i]);
+	}
+	mismatches = 0;
+	for (size_t i = 0; i < elements.size(); i++) {
+		if (filter.Check(elements[i]) != reference.Check(elements[i], true)) mismatches++;
+	}
+	CHECK(mismatches == 0);
+
+	std::remove("test-cbf-multilayer.txt");
+}
+
+//adaptive counters must widen to 2 and then 4 bytes, keeping the counters,
+//and adaptive filters of different widths must merge
+static void test_adaptive() {
+	cbf::CBFConfig config = counters_config(1, 0);
+	config.adaptive = true;
+	cbf::CBF filter(0, 5, 4, 100000, "test-cbf-adaptive.txt", config);
+	cbf::CBF narrow(0, 5, 4, 100000, "test-cbf-adaptive.txt", config);
+	const long long cells = (long long) config.cells;
+
+	filter.Insert(std::string_view("small"), 3);
+	filter.Insert(std::string_view("heavy"), 1000);
+	CHECK(filter.GetLayerMemory(0) >= 2 * cells);
+	CHECK(filter.Check(std::string_view("heavy")) >= 1000);
+	CHECK(filter.Check(std::string_view("small")) >= 3);
+
+	filter.Insert(std::string_view("heavier"), 100000);
+	CHECK(filter.GetLayerMemory(0) >= 4 * cells);
+	CHECK(filter.Check(std::string_view("heavier")) >= 100000);
+	CHECK(filter.Check(std::string_view("heavy")) >= 1000);
+	CHECK(filter.GetOverallOverflows() == 0);
+
+	narrow.Insert(std::string_view("heavy"), 5);
+	CHECK(narrow.GetLayerMemory(0) < 2 * cells);
+	filter.Merge(narrow);
+	CHECK(filter.Check(std::string_view("heavy")) >= 1005);
+	narrow.Merge(filter);
+	CHECK(narrow.GetLayerMemory(0) >= 4 * cells);
+	CHECK(narrow.Check(std::string_view("heavier")) >= 100000);
+
+	std::remove("test-cbf-adaptive.txt");
+}
+
+int main(int argc, char** argv) {
+	struct Test {
+		const char *name;
+		void (*run)();
+	};
+	const Test tests[] = {
+		{ "bulk_insert", test_bulk_insert },
+		{ "save_load", test_save_load },
+		{ "remove_underflow", test_remove_underflow },
+		{ "multilayer_exact", test_multilayer_exact },
+		{ "adaptive", test_adaptive },
+	};
+
+	if (argc != 2) {
+		printf("Usage: testCBF <test name>\n");
+		return 2;
+	}
+
+	make_elements(20000);
+	for (const Test &test : tests) {
+		if (strcmp(argv[1], test.name) != 0) continue;
+		try {
+			test.run();
+		} catch (const std::exception &e) {
+			printf("%s: unexpected exception: %s\n", test.name, e.what());
+			failures++;
+		}
+		printf("%s: %d failed checks\n", test.name, failures);
+		return failures == 0 ? 0 : 1;
+	}
+
+	printf("Unknown test %s\n", argv[1]);
+	return 2;
+}
@@ -0,0 +1,108 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "windowed.h"
+
+#include <climits>
+#include <string.h>
+#include <stdexcept>
+
+namespace cbf {
+
+
+WindowedCBF::WindowedCBF(int generations, int bit_mapping, int HASH_family, int HASH_number,
+        int MULTIPLICITY_max, const std::string& salt_path, const CBFConfig& config) {
+	if (generations <= 0 || generations > MAX_GENERATIONS) throw std::invalid_argument("Invalid number of generations.");
+
+	for (int g = 0; g < generations; g++) {
+		this->ring.emplace_back(new CBF(bit_mapping, HASH_family, HASH_number, MULTIPLICITY_max, salt_path, config));
+	}
+	// The generations share the salts of the first one, so that they map
+	// elements to the same cells
+	for (int g = 1; g < generations; g++) {
+		for (int j = 0; j < HASH_number; j++) {
+			memcpy(this->ring[g]->HASH_salt[j], this->ring[0]->HASH_salt[j], CBF::MAX_INPUT_SIZE);
+		}
+	}
+}
+
+void WindowedCBF::Insert(std::string_view element, int multiplicity) {
+	CBF &generation = *this->ring[this->current];
+	uint64_t indices[CBF::MAX_HASH_NUMBER];
+
+	for (int k = 0; k < generation.HASH_number;) {
+		k += generation.ComputeIndices(element, indices, k);
+	}
+
+	(generation.*generation.insert_kernel)(indices, multiplicity);
+	if (generation.adaptive) generation.PromoteCells();
+
+	generation.AddMembers(1, multiplicity);
+}
+
+// The cell indices are computed once, and the counter of each generation is
+// resolved from them. Generations where the element is not found add 0.
+int WindowedCBF::Check(std::string_view element, bool with_overflows) const {
+	const CBF &first = *this->ring[this->current];
+	uint64_t indices[CBF::MAX_HASH_NUMBER];
+	long long counter = 0;
+
+	for (int k = 0; k < first.HASH_number;) {
+		k += first.ComputeIndices(element, indices, k);
+	}
+
+	for (const auto &generation : this->ring) {
+		counter += (generation.get()->*generation->resolve_kernel)(indices, with_overflows);
+	}
+
+	return (int) std::min(counter, (long long) INT_MAX);
+}
+
+void WindowedCBF::Advance() {
+	this->current = (this->current + 1) % (int) this->ring.size();
+	this->ring[this->current]->Clear();
+}
+
+const CBF &WindowedCBF::GetGeneration(int age) const {
+	const int generations = (int) this->ring.size();
+	if (age < 0 || age >= generations) throw std::out_of_range("Invalid generation.");
+
+	return *this->ring[(this->current - age + generations) % generations];
+}
+
+long long WindowedCBF::GetMembers() const {
+	long long members = 0;
+	for (const auto &generation : this->ring) members += generation->GetMembers();
+	return members;
+}
+
+long long WindowedCBF::GetUniqueMembers() const {
+	long long unique_members = 0;
+	for (const auto &generation : this->ring) unique_members += generation->GetUniqueMembers();
+	return unique_members;
+}
+
+} //namespace cbf
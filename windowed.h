@@ -0,0 +1,96 @@
+/*
+    Counting Bloom Filter C++ Library (libCBF-cpp)
+
+    Copyright (C) 2020 Lorenzo Pellegrini
+    University of Bologna
+
+    Based on Spatial Bloom Filter C++ Library (libSBF-cpp)
+    Copyright (C) 2017  Luca Calderoni, Dario Maio,
+    University of Bologna
+    Copyright (C) 2017  Paolo Palmieri,
+    Cranfield University
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifndef WINDOWED_H
+#define WINDOWED_H
+
+#include "cbf.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cbf {
+
+// Counting Bloom filter over a sliding window of the stream, made of a ring
+// of generations: CBFs with the same parameters and hash salts, so that an
+// element maps to the same cells in all of them. Insert maps elements to the
+// current generation, and Check sums the counters of an element over all the
+// generations. Advance expires the oldest generation, whose counters are
+// zeroed in a single pass, and makes it the current one. Elements inserted
+// since the last 'generations' calls to Advance are counted, older ones are
+// forgotten, with no rebuild and no Remove.
+// Windowed CBFs are not thread safe: Advance must not run while other
+// threads insert or check.
+class DLL_PUBLIC WindowedCBF {
+
+private:
+	// The generations, the current one at index 'current' and the older
+	// ones before it, in the order of the ring
+	std::vector<std::unique_ptr<CBF> > ring;
+	int current = 0;
+
+public:
+	// The maximum number of generations
+	const static int MAX_GENERATIONS = 1024;
+
+	// WindowedCBF class constructor
+	// Arguments:
+	// generations      the number of generations of the window
+	// The other arguments are those of the CBF constructor. All the
+	// generations share the hash salts of salt_path (created if the file
+	// does not exist). Filters in the conservative update
+	// mode (see CBFConfig) only apply it within a generation, and adaptive
+	// filters widen each generation on its own.
+	WindowedCBF(int generations, int bit_mapping, int HASH_family, int HASH_number,
+	        int MULTIPLICITY_max, const std::string& salt_path, const CBFConfig& config = CBFConfig());
+
+	// Maps an element to the current generation. Its cell indices are
+	// computed once.
+	void Insert(std::string_view element, int multiplicity);
+	// Returns the counter of an element over the window: the sum of its
+	// counters (see CBF::Check) in all the generations
+	int Check(std::string_view element, bool with_overflows = false) const;
+	// Expires the oldest generation, which becomes the current one
+	void Advance();
+
+	// Returns the number of generations
+	int GetGenerations() const { return (int) this->ring.size(); }
+	// Returns a generation by age: 0 is the current one and
+	// GetGenerations() - 1 the oldest one
+	const CBF &GetGeneration(int age) const;
+	// Returns the number of elements (multiplicities included) and of
+	// unique elements mapped over the window
+	long long GetMembers() const;
+	long long GetUniqueMembers() const;
+};
+
+} //namespace cbf
+
+#endif /* WINDOWED_H */